@@ -22,15 +22,26 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     int numLights;
 } ubo;
 
-layout(push_constant) uniform Push {
+struct Instance {
     mat4 modelMatrix;
     mat4 normalMatrix;
-} push;
+};
+
+// written by SimpleRenderSystem every frame, one entry per drawn object
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+// which instance every gl_InstanceIndex draws, the cull pass compacts the visible ones to the front of each draw
+layout(std430, set = 1, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visibleInstances[];
+};
 
 void main() {
-    vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);    // to make sure we calculate in world space and not e.g. model space
+    Instance instance = instances[visibleInstances[gl_InstanceIndex]];
+    vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);    // to make sure we calculate in world space and not e.g. model space
     gl_Position = ubo.projection * (ubo.view * positionWorld);      // parentheses to force less expensive calc. order
-    fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+    fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
     fragPosWorld = positionWorld.xyz;
     fragColor = color;
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#version 450
+
+// same as simple_shader.vert but for HuhuModel::PackedVertex, the attribute formats already turn everything into floats
+layout(location = 0) in vec4 position;  // unorm within the model bounds, the instance model matrix maps it back
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 normal;    // octahedral encoded
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+
+struct PointLight {
+    vec4 position;  // ignore w
+    vec4 color;     // w is intensity
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projection;
+    mat4 view;
+    vec4 ambientLightColor; // w is light intensity
+    PointLight pointLights[10]; // needs to match MAX_LIGHTS in huhu_frame_info.hpp (GH Issue #4)
+    int numLights;
+} ubo;
+
+struct Instance {
+    mat4 modelMatrix;   // already includes the position decode
+    mat4 normalMatrix;
+};
+
+// written by SimpleRenderSystem every frame, one entry per drawn object
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+// which instance every gl_InstanceIndex draws, the cull pass compacts the visible ones to the front of each draw
+layout(std430, set = 1, binding = 1) readonly buffer VisibleInstanceBuffer {
+    uint visibleInstances[];
+};
+
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-n.z, 0.0);   // unfold the lower half
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main() {
+    Instance instance = instances[visibleInstances[gl_InstanceIndex]];
+    vec4 positionWorld = instance.modelMatrix * vec4(position.xyz, 1.0);
+    gl_Position = ubo.projection * (ubo.view * positionWorld);
+    fragNormalWorld = normalize(mat3(instance.normalMatrix) * decodeOctahedral(normal));
+    fragPosWorld = positionWorld.xyz;
+    fragColor = color.rgb;
+}
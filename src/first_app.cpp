@@ -16,6 +16,7 @@
 #include <array>
 #include <chrono>
 #include <cassert>
+#include <iostream>
 #include <stdexcept>
 
 namespace huhu
@@ -23,8 +24,8 @@ namespace huhu
     FirstApp::FirstApp()
     {
         globalPool = HuhuDescriptorPool::Builder(huhuDevice)
-                         .setMaxSets(HuhuSwapChain::MAX_FRAMES_IN_FLIGHT)
-                         .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, HuhuSwapChain::MAX_FRAMES_IN_FLIGHT)
+                         .setMaxSets(1)
+                         .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1)
                          .build();
         loadGameObjects();
     }
@@ -33,31 +34,17 @@ namespace huhu
 
     void FirstApp::run()
     {
-        std::vector<std::unique_ptr<HuhuBuffer>> uboBuffers(HuhuSwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < uboBuffers.size(); i++)
-        {
-            uboBuffers[i] = std::make_unique<HuhuBuffer>(
-                huhuDevice,
-                sizeof(GlobalUbo),
-                1,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-            uboBuffers[i]->map();
-        }
-
+        // one set for every frame, the GlobalUbo lives in the uniform ring and gets picked by dynamic offset
         auto globalSetLayout =
             HuhuDescriptorSetLayout::Builder(huhuDevice)
-                .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+                .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
                 .build();
 
-        std::vector<VkDescriptorSet> globalDescriptorSets(HuhuSwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < globalDescriptorSets.size(); i++)
-        {
-            auto bufferInfo = uboBuffers[i]->descriptorInfo();
-            HuhuDescriptorWriter(*globalSetLayout, *globalPool)
-                .writeBuffer(0, &bufferInfo)
-                .build(globalDescriptorSets[i]);
-        }
+        VkDescriptorSet globalDescriptorSet;
+        auto bufferInfo = uniformRing.descriptorInfo(sizeof(GlobalUbo));
+        HuhuDescriptorWriter(*globalSetLayout, *globalPool)
+            .writeBuffer(0, &bufferInfo)
+            .build(globalDescriptorSet);
 
         SimpleRenderSystem simpleRenderSystem{
             huhuDevice,
@@ -74,6 +61,7 @@ namespace huhu
         KeyboardMovementController cameraController{};
 
         auto currentTime = std::chrono::high_resolution_clock::now();
+        float memoryLogTimer = 0.f;
 
         while (!huhuWindow.shouldClose())
         {
@@ -83,6 +71,17 @@ namespace huhu
             float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
             currentTime = newTime;
 
+            memoryLogTimer += frameTime;
+            if (memoryLogTimer >= MEMORY_LOG_INTERVAL)
+            {
+                memoryLogTimer = 0.f;
+                huhuDevice.getMemoryStats().log(std::cout);
+            }
+
+            assetLoader.update();
+            modelCache.update();
+            swapInLoadedModels();
+
             cameraController.moveInPlaneYXZ(huhuWindow.getGlfwWindow(), frameTime, viewerObject);
             camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
 
@@ -93,27 +92,32 @@ namespace huhu
             if (auto commandBuffer = huhuRenderer.beginFrame())
             {
                 int frameIndex = huhuRenderer.getFrameIndex();
+                uniformRing.beginFrame(frameIndex);
                 FrameInfo frameInfo{
                     frameIndex,
                     frameTime,
                     commandBuffer,
                     camera,
-                    globalDescriptorSets[frameIndex],
-                    gameObjects};
+                    globalDescriptorSet,
+                    0,
+                    gameObjects,
+                    uniformRing,
+                    huhuRenderer.getFrameArena()};
 
                 // updating
                 GlobalUbo ubo{};
                 ubo.projection = camera.getProjection();
                 ubo.view = camera.getView();
                 pointLightSystem.update(frameInfo, ubo);
-                uboBuffers[frameIndex]->writeToBuffer(&ubo);
-                uboBuffers[frameIndex]->flush();
+                frameInfo.globalUboOffset = uniformRing.push(&ubo, sizeof(GlobalUbo));
 
-                // rendering
+                // rendering, the culling pass has to be recorded outside the render pass
+                simpleRenderSystem.prepare(frameInfo);
                 huhuRenderer.beginSwapChainRenderPass(commandBuffer);
                 simpleRenderSystem.renderGameObjects(frameInfo);
                 pointLightSystem.render(frameInfo);
                 huhuRenderer.endSwapChainRenderPass(commandBuffer);
+                uniformRing.flush();
                 huhuRenderer.endFrame();
             }
         }
@@ -121,28 +125,64 @@ namespace huhu
         vkDeviceWaitIdle(huhuDevice.device());
     }
 
+    void FirstApp::swapInLoadedModels()
+    {
+        for (auto it = pendingModels.begin(); it != pendingModels.end();)
+        {
+            auto &[id, handle] = *it;
+            if (handle.getStatus() == HuhuAssetLoader::Status::Loading)
+            {
+                ++it;
+                continue;
+            }
+
+            if (handle.isResident())
+                gameObjects.at(id).model = handle.getModel();
+            it = pendingModels.erase(it); // failed loads just keep the placeholder
+        }
+    }
+
     // currently this is our "scene"
     void FirstApp::loadGameObjects()
     {
-        std::shared_ptr<HuhuModel> huhuModel;
-
-        huhuModel = HuhuModel::createModelFromFile(huhuDevice, "models/flat_vase.obj");
+        // small cube loaded right away, stands in for models that are still loading
+        HuhuModel::Builder placeholderBuilder{};
+        placeholderBuilder.loadModel("models/cube.obj");
+        for (auto &vertex : placeholderBuilder.vertices)
+        {
+            vertex.position *= .05f;
+        }
+        placeholderBuilder.computeBounds();
+        auto placeholderModel = std::make_shared<HuhuModel>(huhuDevice, placeholderBuilder);
+        HuhuAssetLoader::ModelHandle modelHandle;
+
+        ModelConfigInfo modelConfig{};
+        modelConfig.optimizeMesh = true;
+        modelConfig.vertexFormat = VertexFormat::Packed;
+        modelConfig.lodTargetErrors = {.002f, .01f, .04f};
+        modelConfig.buildMeshlets = true;
+        modelConfig.geometryArena = &geometryArena;
+
+        modelHandle = modelCache.acquire("models/flat_vase.obj", modelConfig);
         auto flatVase = HuhuGameObject::createGameObject();
-        flatVase.model = huhuModel;
+        flatVase.model = placeholderModel;
+        pendingModels.emplace_back(flatVase.getId(), modelHandle);
         flatVase.transform.translation = {-.5f, .5f, .0f};
         flatVase.transform.scale = {3.f, 1.5f, 3.f};
         gameObjects.emplace(flatVase.getId(), std::move(flatVase));
 
-        huhuModel = HuhuModel::createModelFromFile(huhuDevice, "models/smooth_vase.obj");
+        modelHandle = modelCache.acquire("models/smooth_vase.obj", modelConfig);
         auto smoothVase = HuhuGameObject::createGameObject();
-        smoothVase.model = huhuModel;
+        smoothVase.model = placeholderModel;
+        pendingModels.emplace_back(smoothVase.getId(), modelHandle);
         smoothVase.transform.translation = {.5f, .5f, .0f};
         smoothVase.transform.scale = {3.f, 1.5f, 3.f};
         gameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
 
-        huhuModel = HuhuModel::createModelFromFile(huhuDevice, "models/quad.obj");
+        modelHandle = modelCache.acquire("models/quad.obj", modelConfig);
         auto floor = HuhuGameObject::createGameObject();
-        floor.model = huhuModel;
+        floor.model = placeholderModel;
+        pendingModels.emplace_back(floor.getId(), modelHandle);
         floor.transform.translation = {.0f, 0.5f, .0f};
         floor.transform.scale = {3.f, 1.f, 3.f};
         gameObjects.emplace(floor.getId(), std::move(floor));
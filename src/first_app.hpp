@@ -3,9 +3,12 @@
 // huhu
 #include "huhu_window.hpp"
 #include "huhu_device.hpp"
+#include "huhu_asset_loader.hpp"
+#include "huhu_model_cache.hpp"
 #include "huhu_game_object.hpp"
 #include "huhu_renderer.hpp"
 #include "huhu_descriptors.hpp"
+#include "huhu_uniform_ring.hpp"
 
 // std
 #include <memory>
@@ -18,6 +21,7 @@ namespace huhu
     public:
         static constexpr int WIDTH = 800;
         static constexpr int HEIGHT = 600;
+        static constexpr float MEMORY_LOG_INTERVAL = 10.f; // seconds between memory stats in the log
 
         FirstApp();
         ~FirstApp();
@@ -29,12 +33,18 @@ namespace huhu
 
     private:
         void loadGameObjects();
+        void swapInLoadedModels();
 
         HuhuWindow huhuWindow{WIDTH, HEIGHT, "Hoot hoot!"};
         HuhuDevice huhuDevice{huhuWindow};
         HuhuRenderer huhuRenderer{huhuWindow, huhuDevice};
+        HuhuUniformRing uniformRing{huhuDevice};
+        HuhuGeometryArena geometryArena{huhuDevice}; // outlives every model placed in it
+        HuhuAssetLoader assetLoader{huhuDevice};
+        HuhuModelCache modelCache{assetLoader};
 
         std::unique_ptr<HuhuDescriptorPool> globalPool{};
         HuhuGameObject::Map gameObjects;
+        std::vector<std::pair<HuhuGameObject::id_t, HuhuAssetLoader::ModelHandle>> pendingModels{}; // objects still showing the placeholder
     };
 }
\ No newline at end of file
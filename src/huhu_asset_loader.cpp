@@ -0,0 +1,307 @@
+#include "huhu_asset_loader.hpp"
+
+#include "huhu_staging_ring.hpp"
+
+// std
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace huhu
+{
+    HuhuAssetLoader::HuhuAssetLoader(HuhuDevice &device, HuhuThreadPool &threadPool) : huhuDevice{device}, threadPool{threadPool}
+    {
+        QueueFamilyIndices indices = huhuDevice.findPhysicalQueueFamilies();
+        graphicsFamily = indices.graphicsFamily;
+        transferFamily = indices.transferFamily;
+        createCommandPools();
+    }
+
+    HuhuAssetLoader::~HuhuAssetLoader()
+    {
+        waitIdle(); // workers still write into our models and the gpu into their buffers
+        vkDestroyCommandPool(huhuDevice.device(), transferCommandPool, nullptr);
+        if (acquireCommandPool != VK_NULL_HANDLE)
+        {
+            vkDestroyCommandPool(huhuDevice.device(), acquireCommandPool, nullptr);
+        }
+    }
+
+    void HuhuAssetLoader::createCommandPools()
+    {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = transferFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        if (vkCreateCommandPool(huhuDevice.device(), &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create transfer command pool!");
+        }
+
+        if (transferFamily != graphicsFamily)
+        {
+            poolInfo.queueFamilyIndex = graphicsFamily;
+            if (vkCreateCommandPool(huhuDevice.device(), &poolInfo, nullptr, &acquireCommandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create transfer command pool!");
+            }
+        }
+    }
+
+    HuhuAssetLoader::ModelHandle HuhuAssetLoader::loadModel(const std::string &filepath, const ModelConfigInfo &configInfo)
+    {
+        ModelHandle handle{};
+        handle.state = std::make_shared<ModelHandle::State>();
+
+        HuhuDevice &device = huhuDevice;
+        auto result = threadPool.submit([&device, filepath, configInfo]()
+                                        {
+                                            auto loaded = std::make_unique<LoadedModel>();
+                                            loaded->model = HuhuModel::createModelFromFile(device, filepath, configInfo, loaded->upload);
+                                            return loaded; });
+
+        pendingLoads.push_back({filepath, handle, std::move(result)});
+        return handle;
+    }
+
+    void HuhuAssetLoader::update()
+    {
+        for (auto it = pendingLoads.begin(); it != pendingLoads.end();)
+        {
+            if (it->result.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+            {
+                ++it;
+                continue;
+            }
+
+            try
+            {
+                stagingModels.push_back({it->handle, it->result.get()});
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "failed to load model " << it->filepath << ": " << e.what() << std::endl;
+                it->handle.state->status = Status::Failed;
+            }
+            it = pendingLoads.erase(it);
+        }
+
+        retireUploads(); // first, so the ring has as much room as possible
+        if (!stagingModels.empty())
+        {
+            submitUploads();
+        }
+    }
+
+    void HuhuAssetLoader::waitIdle()
+    {
+        while (!isIdle())
+        {
+            if (!uploadBatches.empty())
+            {
+                huhuDevice.stagingRing().wait(uploadBatches.front().ticket);
+            }
+            else if (stagingModels.empty())
+            {
+                pendingLoads.front().result.wait();
+            }
+            update();
+        }
+    }
+
+    VkCommandBuffer HuhuAssetLoader::beginCommandBuffer(VkCommandPool commandPool)
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(huhuDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+    void HuhuAssetLoader::submitUploads()
+    {
+        const bool ownershipTransfer = transferFamily != graphicsFamily;
+        HuhuStagingRing &ring = huhuDevice.stagingRing();
+
+        // stage in load order until the ring is full, models that are done ride along with the batch
+        UploadBatch batch{};
+        std::vector<HuhuModel::StagedUpload::Copy> copies{};
+        while (!stagingModels.empty())
+        {
+            StagingModel &staging = stagingModels.front();
+            if (!staging.loaded->upload.stage(ring, copies))
+                break;
+
+            staging.loaded->upload.source.reset(); // mesh data isn't needed once it's in the ring
+            batch.handles.push_back(std::move(staging.handle));
+            batch.models.push_back(std::move(staging.loaded));
+            stagingModels.pop_front();
+        }
+        if (copies.empty())
+            return; // the ring is still busy with earlier batches
+
+        // every copy of the batch goes into one command buffer
+        batch.transferCommandBuffer = beginCommandBuffer(transferCommandPool);
+        std::vector<VkBufferMemoryBarrier> ownershipBarriers{};
+        for (const auto &copy : copies)
+        {
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = copy.srcOffset;
+            copyRegion.dstOffset = copy.dstOffset;
+            copyRegion.size = copy.size;
+            vkCmdCopyBuffer(batch.transferCommandBuffer, ring.getBuffer(), copy.dstBuffer, 1, &copyRegion);
+
+            // concurrent sharing needs no ownership transfer, the semaphore alone makes the writes visible. Own
+            // buffers stay with the transfer family until their last piece is in.
+            if (copy.sharedDestination || !copy.lastChunk)
+                continue;
+
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = transferFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            barrier.buffer = copy.dstBuffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+            ownershipBarriers.push_back(barrier);
+        }
+
+        if (ownershipTransfer && !ownershipBarriers.empty())
+        {
+            // release half of the ownership transfer, the graphics queue acquires below
+            for (auto &barrier : ownershipBarriers)
+            {
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+            }
+            vkCmdPipelineBarrier(
+                batch.transferCommandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                0, nullptr,
+                static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(),
+                0, nullptr);
+        }
+        else if (!ownershipTransfer)
+        {
+            // same queue as rendering, later frames only need to see the writes
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            vkCmdPipelineBarrier(
+                batch.transferCommandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0,
+                1, &barrier,
+                0, nullptr,
+                0, nullptr);
+        }
+        vkEndCommandBuffer(batch.transferCommandBuffer);
+
+        const HuhuStagingRing::Submission submission = ring.endSubmission();
+        batch.ticket = submission.ticket;
+
+        VkSubmitInfo transferSubmit{};
+        transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        transferSubmit.commandBufferCount = 1;
+        transferSubmit.pCommandBuffers = &batch.transferCommandBuffer;
+
+        if (!ownershipTransfer)
+        {
+            if (vkQueueSubmit(huhuDevice.transferQueue(), 1, &transferSubmit, submission.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to submit model uploads!");
+            }
+            uploadBatches.push_back(std::move(batch));
+            return;
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (vkCreateSemaphore(huhuDevice.device(), &semaphoreInfo, nullptr, &batch.transferDone) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload semaphore!");
+        }
+        transferSubmit.signalSemaphoreCount = 1;
+        transferSubmit.pSignalSemaphores = &batch.transferDone;
+        if (vkQueueSubmit(huhuDevice.transferQueue(), 1, &transferSubmit, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit model uploads!");
+        }
+
+        // acquire half, has to match the release barriers exactly
+        batch.acquireCommandBuffer = beginCommandBuffer(acquireCommandPool);
+        for (auto &barrier : ownershipBarriers)
+        {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        }
+        if (!ownershipBarriers.empty())
+        {
+            vkCmdPipelineBarrier(
+                batch.acquireCommandBuffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0,
+                0, nullptr,
+                static_cast<uint32_t>(ownershipBarriers.size()), ownershipBarriers.data(),
+                0, nullptr);
+        }
+        vkEndCommandBuffer(batch.acquireCommandBuffer);
+
+        const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        VkSubmitInfo acquireSubmit{};
+        acquireSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireSubmit.waitSemaphoreCount = 1;
+        acquireSubmit.pWaitSemaphores = &batch.transferDone;
+        acquireSubmit.pWaitDstStageMask = &waitStage;
+        acquireSubmit.commandBufferCount = 1;
+        acquireSubmit.pCommandBuffers = &batch.acquireCommandBuffer;
+        if (vkQueueSubmit(huhuDevice.graphicsQueue(), 1, &acquireSubmit, submission.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit model uploads!");
+        }
+        uploadBatches.push_back(std::move(batch));
+    }
+
+    void HuhuAssetLoader::retireUploads()
+    {
+        for (auto it = uploadBatches.begin(); it != uploadBatches.end();)
+        {
+            if (!huhuDevice.stagingRing().isComplete(it->ticket))
+            {
+                ++it;
+                continue;
+            }
+
+            for (size_t i = 0; i < it->handles.size(); i++)
+            {
+                it->handles[i].state->model = std::move(it->models[i]->model);
+                it->handles[i].state->status = Status::Resident;
+            }
+
+            vkFreeCommandBuffers(huhuDevice.device(), transferCommandPool, 1, &it->transferCommandBuffer);
+            if (it->acquireCommandBuffer != VK_NULL_HANDLE)
+            {
+                vkFreeCommandBuffers(huhuDevice.device(), acquireCommandPool, 1, &it->acquireCommandBuffer);
+                vkDestroySemaphore(huhuDevice.device(), it->transferDone, nullptr);
+            }
+            it = uploadBatches.erase(it);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "huhu_device.hpp"
+#include "huhu_model.hpp"
+#include "huhu_thread_pool.hpp"
+
+// std
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace huhu
+{
+    // Loads models in the background so the render loop never blocks on them. Parsing, mesh processing and creating
+    // the buffers run on the thread pool. update() then streams the data through the device's staging ring, spreading
+    // models that don't fit at once over several frames, and submits the copies on the transfer queue (a dedicated
+    // family if the device has one, with a queue ownership transfer over to graphics). Completion is tracked with the
+    // ring's tickets.
+    class HuhuAssetLoader
+    {
+    public:
+        enum class Status
+        {
+            Loading,
+            Resident,
+            Failed
+        };
+
+        // Future-like handle to a model that might not be usable yet. Copies share the same state, which only
+        // changes inside update(), so check it on the render thread.
+        class ModelHandle
+        {
+        public:
+            Status getStatus() const { return state ? state->status : Status::Failed; }
+            bool isResident() const { return getStatus() == Status::Resident; }
+            // nullptr until the model is resident, draw a placeholder until then
+            std::shared_ptr<HuhuModel> getModel() const { return isResident() ? state->model : nullptr; }
+
+        private:
+            friend class HuhuAssetLoader;
+            friend class HuhuModelCache; // counts references through the shared state
+
+            struct State
+            {
+                Status status = Status::Loading;
+                std::shared_ptr<HuhuModel> model{};
+            };
+            std::shared_ptr<State> state{};
+        };
+
+        HuhuAssetLoader(HuhuDevice &device, HuhuThreadPool &threadPool = HuhuThreadPool::shared());
+        ~HuhuAssetLoader();
+
+        HuhuAssetLoader(const HuhuAssetLoader &) = delete;
+        HuhuAssetLoader &operator=(const HuhuAssetLoader &) = delete;
+
+        ModelHandle loadModel(const std::string &filepath, const ModelConfigInfo &configInfo = ModelConfigInfo{});
+
+        // Call once per frame from the render thread (it's the only one touching the queues). Stages as much of the
+        // parsed models as the ring has room for, submits that as one batch and marks models resident whose upload
+        // has finished.
+        void update();
+        // blocks until nothing is loading anymore, for loading screens and shutdown
+        void waitIdle();
+        bool isIdle() const { return pendingLoads.empty() && stagingModels.empty() && uploadBatches.empty(); }
+
+    private:
+        struct LoadedModel
+        {
+            std::unique_ptr<HuhuModel> model;
+            HuhuModel::StagedUpload upload;
+        };
+
+        struct PendingLoad
+        {
+            std::string filepath;
+            ModelHandle handle;
+            std::future<std::unique_ptr<LoadedModel>> result;
+        };
+
+        struct StagingModel
+        {
+            ModelHandle handle;
+            std::unique_ptr<LoadedModel> loaded;
+        };
+
+        struct UploadBatch
+        {
+            uint64_t ticket = 0; // staging ring submission
+            VkSemaphore transferDone = VK_NULL_HANDLE; // only with a dedicated transfer family
+            VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+            VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE; // takes ownership on the graphics queue
+            std::vector<ModelHandle> handles{}; // models whose last piece is in this batch
+            std::vector<std::unique_ptr<LoadedModel>> models{};
+        };
+
+        void createCommandPools();
+        void submitUploads();
+        VkCommandBuffer beginCommandBuffer(VkCommandPool commandPool);
+        void retireUploads();
+
+        HuhuDevice &huhuDevice;
+        HuhuThreadPool &threadPool;
+
+        uint32_t graphicsFamily;
+        uint32_t transferFamily;
+        VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+        VkCommandPool acquireCommandPool = VK_NULL_HANDLE; // graphics family, only with a dedicated transfer family
+
+        std::vector<PendingLoad> pendingLoads{};
+        std::deque<StagingModel> stagingModels{}; // parsed, in load order, the front one may be partly staged
+        std::vector<UploadBatch> uploadBatches{};
+    };
+}
@@ -53,8 +53,12 @@ namespace huhu
     HuhuBuffer::~HuhuBuffer()
     {
         unmap();
-        vkDestroyBuffer(huhuDevice.device(), buffer, nullptr);
-        vkFreeMemory(huhuDevice.device(), memory, nullptr);
+        huhuDevice.deletionQueue().defer(
+            [&device = huhuDevice, buffer = buffer, memory = memory]()
+            {
+                vkDestroyBuffer(device.device(), buffer, nullptr);
+                device.freeMemory(memory);
+            });
     }
 
     /**
@@ -64,26 +68,32 @@ namespace huhu
      * buffer range.
      * @param offset (Optional) Byte offset from beginning
      *
+     * @note The memory is shared with other buffers and mapped persistently by the allocator, so this only
+     * hands out a pointer into that mapping
+     *
      * @return VkResult of the buffer mapping call
      */
     VkResult HuhuBuffer::map(VkDeviceSize size, VkDeviceSize offset)
     {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(huhuDevice.device(), memory, offset, size, 0, &mapped);
+        assert(buffer && memory.memory && "Called map on buffer before create");
+        assert(offset <= bufferSize && (size == VK_WHOLE_SIZE || size <= bufferSize - offset) && "Mapped range is outside the buffer");
+        (void)size; // only checked above, release builds drop the assert
+        if (!memory.mapped)
+        {
+            return VK_ERROR_MEMORY_MAP_FAILED; // not host visible
+        }
+        mapped = static_cast<char *>(memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
     /**
      * Unmap a mapped memory range
      *
-     * @note Does not return a result as vkUnmapMemory can't fail
+     * @note The allocator keeps the memory itself mapped, this just forgets the pointer
      */
     void HuhuBuffer::unmap()
     {
-        if (mapped)
-        {
-            vkUnmapMemory(huhuDevice.device(), memory);
-            mapped = nullptr;
-        }
+        mapped = nullptr;
     }
 
     /**
@@ -94,6 +104,7 @@ namespace huhu
      * range.
      * @param offset (Optional) Byte offset from beginning of mapped region
      *
+     * @note The written range is marked dirty, it's flushed with the rest of the frame's writes
      */
     void HuhuBuffer::writeToBuffer(void *data, VkDeviceSize size, VkDeviceSize offset)
     {
@@ -109,6 +120,7 @@ namespace huhu
             memOffset += offset;
             memcpy(memOffset, data, size);
         }
+        markDirty(size, size == VK_WHOLE_SIZE ? 0 : offset);
     }
 
     /**
@@ -124,14 +136,21 @@ namespace huhu
      */
     VkResult HuhuBuffer::flush(VkDeviceSize size, VkDeviceSize offset)
     {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        VkMappedMemoryRange mappedRange = huhuDevice.getMappedRange(memory, offset, size);
         return vkFlushMappedMemoryRanges(huhuDevice.device(), 1, &mappedRange);
     }
 
+    /**
+     * Queue a memory range of the buffer for the batched flush the renderer issues once per frame, instead of
+     * flushing it right away
+     *
+     * @note Only does something for non-coherent memory
+     *
+     * @param size (Optional) Size of the memory range. Pass VK_WHOLE_SIZE for the complete buffer range.
+     * @param offset (Optional) Byte offset from beginning
+     */
+    void HuhuBuffer::markDirty(VkDeviceSize size, VkDeviceSize offset) { huhuDevice.markDirty(memory, offset, size); }
+
     /**
      * Invalidate a memory range of the buffer to make it visible to the host
      *
@@ -145,11 +164,7 @@ namespace huhu
      */
     VkResult HuhuBuffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
     {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
+        VkMappedMemoryRange mappedRange = huhuDevice.getMappedRange(memory, offset, size);
         return vkInvalidateMappedMemoryRanges(huhuDevice.device(), 1, &mappedRange);
     }
 
@@ -190,6 +205,13 @@ namespace huhu
      */
     VkResult HuhuBuffer::flushIndex(int index) { return flush(alignmentSize, index * alignmentSize); }
 
+    /**
+     * Queue the memory range of a buffer at index for the batched per frame flush
+     *
+     * @param index Used in offset calculation
+     */
+    void HuhuBuffer::markDirtyIndex(int index) { markDirty(alignmentSize, index * alignmentSize); }
+
     /**
      * Create a buffer info descriptor
      *
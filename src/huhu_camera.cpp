@@ -49,6 +49,7 @@ namespace huhu
         viewMatrix[3][0] = -glm::dot(u, position);
         viewMatrix[3][1] = -glm::dot(v, position);
         viewMatrix[3][2] = -glm::dot(w, position);
+        this->position = position;
     }
 
     void HuhuCamera::setViewTarget(glm::vec3 position, glm::vec3 target, glm::vec3 up)
@@ -80,5 +81,25 @@ namespace huhu
         viewMatrix[3][0] = -glm::dot(u, position);
         viewMatrix[3][1] = -glm::dot(v, position);
         viewMatrix[3][2] = -glm::dot(w, position);
+        this->position = position;
+    }
+
+    // Gribb/Hartmann plane extraction from the view projection matrix, assumes 0..1 depth
+    std::array<glm::vec4, 6> HuhuCamera::getFrustumPlanes() const
+    {
+        const glm::mat4 m = glm::transpose(projectionMatrix * viewMatrix); // rows become columns, m[i] is row i
+        std::array<glm::vec4, 6> planes = {
+            m[3] + m[0], // left
+            m[3] - m[0], // right
+            m[3] + m[1], // top or bottom, vulkan flips y but we test both anyway
+            m[3] - m[1],
+            m[2],        // near
+            m[3] - m[2], // far
+        };
+        for (auto &plane : planes)
+        {
+            plane /= glm::length(glm::vec3{plane});
+        }
+        return planes;
     }
 }
\ No newline at end of file
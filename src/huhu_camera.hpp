@@ -5,6 +5,9 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE // make depth buffers range to 0 to 1
 #include <glm/glm.hpp>
 
+// std
+#include <array>
+
 namespace huhu
 {
     class HuhuCamera
@@ -19,9 +22,14 @@ namespace huhu
 
         const glm::mat4 &getProjection() const { return projectionMatrix; }
         const glm::mat4 &getView() const { return viewMatrix; }
+        const glm::vec3 &getPosition() const { return position; }
+        // world space, xyz is the normal pointing inwards and w the distance, in order left, right, top/bottom, near
+        // and far
+        std::array<glm::vec4, 6> getFrustumPlanes() const;
 
     private:
         glm::mat4 projectionMatrix{1.f};
         glm::mat4 viewMatrix{1.f};
+        glm::vec3 position{}; // world space, kept around for culling
     };
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "huhu_deletion_queue.hpp"
+
+#include "huhu_swap_chain.hpp"
+
+namespace huhu
+{
+    void HuhuDeletionQueue::defer(std::function<void()> deleter)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        entries.push_back({frame, std::move(deleter)});
+    }
+
+    void HuhuDeletionQueue::beginFrame()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            frame++;
+
+            // every frame up to this one minus the frames in flight has finished on the gpu
+            while (!entries.empty() && entries.front().frame + HuhuSwapChain::MAX_FRAMES_IN_FLIGHT <= frame)
+            {
+                retiring.push_back(std::move(entries.front().deleter));
+                entries.pop_front();
+            }
+        }
+
+        // outside the lock, deleters are free to queue more
+        for (auto &deleter : retiring)
+        {
+            deleter();
+        }
+        retiring.clear();
+    }
+
+    void HuhuDeletionQueue::flush()
+    {
+        // deleters can queue up more, keep going until nothing is left
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                if (entries.empty())
+                    break;
+                for (auto &entry : entries)
+                {
+                    retiring.push_back(std::move(entry.deleter));
+                }
+                entries.clear();
+            }
+
+            for (auto &deleter : retiring)
+            {
+                deleter();
+            }
+            retiring.clear();
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace huhu
+{
+    // Destroys Vulkan objects once no frame that may still use them is in flight, so buffers, images, pipelines and
+    // old swap chains can go away while rendering carries on instead of waiting for the device to idle. Deleters
+    // capture the handles and run MAX_FRAMES_IN_FLIGHT frames after they were queued, which is when the fence of the
+    // last frame that could have recorded them has signaled. Anything only used by other queues has to be waited
+    // for by its owner. Queueing works from any thread.
+    class HuhuDeletionQueue
+    {
+    public:
+        HuhuDeletionQueue() = default;
+        ~HuhuDeletionQueue() { flush(); }
+
+        HuhuDeletionQueue(const HuhuDeletionQueue &) = delete;
+        HuhuDeletionQueue &operator=(const HuhuDeletionQueue &) = delete;
+
+        void defer(std::function<void()> deleter);
+
+        // call once the frame's fence has signaled, runs whatever no frame in flight can reference anymore
+        void beginFrame();
+        // runs everything right away, the device has to be idle
+        void flush();
+
+    private:
+        struct Entry
+        {
+            uint64_t frame; // last frame that may have recorded the handles
+            std::function<void()> deleter;
+        };
+
+        std::mutex mutex;
+        std::deque<Entry> entries;
+        std::vector<std::function<void()>> retiring; // scratch, deleters run without the lock held
+        uint64_t frame = 0;
+    };
+}
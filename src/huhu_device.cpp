@@ -1,4 +1,5 @@
 #include "huhu_device.hpp"
+#include "huhu_staging_ring.hpp"
 #include "huhu_window.hpp"
 
 #include <vulkan/vulkan_beta.h>
@@ -64,12 +65,18 @@ namespace huhu
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
+        allocator = std::make_unique<HuhuMemoryAllocator>(device_, physicalDevice);
         createCommandPool();
+        stagingRing_ = std::make_unique<HuhuStagingRing>(*this);
     }
 
     HuhuDevice::~HuhuDevice()
     {
+        vkDeviceWaitIdle(device_);
+        stagingRing_.reset();
+        deletionQueue_.flush(); // needs the allocator still around
         vkDestroyCommandPool(device_, commandPool, nullptr);
+        allocator.reset();
         vkDestroyDevice(device_, nullptr);
 
         if (enableValidationLayers)
@@ -165,7 +172,7 @@ namespace huhu
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily, indices.transferFamily};
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -178,8 +185,15 @@ namespace huhu
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
+        // optional, indirect drawing falls back to direct draws without them
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+        enabledFeatures = deviceFeatures;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -187,9 +201,19 @@ namespace huhu
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+        // budget queries are optional, the stats fall back to our own bookkeeping without them
+        std::vector<const char *> enabledExtensions = deviceExtensions;
+        getPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+        memoryBudgetSupported = getPhysicalDeviceMemoryProperties2 && isDeviceExtensionAvailable(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetSupported)
+        {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         // might not really be necessary anymore because device specific validation layers
         // have been deprecated
@@ -210,6 +234,7 @@ namespace huhu
 
         vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
         vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+        vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
     }
 
     void HuhuDevice::createCommandPool()
@@ -349,6 +374,22 @@ namespace huhu
         }
     }
 
+    bool HuhuDevice::isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto &extension : availableExtensions)
+        {
+            if (strcmp(extension.extensionName, extensionName) == 0)
+                return true;
+        }
+        return false;
+    }
+
     bool HuhuDevice::checkDeviceExtensionSupport(VkPhysicalDevice device)
     {
         uint32_t extensionCount;
@@ -404,6 +445,25 @@ namespace huhu
             i++;
         }
 
+        // uploads prefer a dma-only family (no graphics or compute), they run alongside rendering there
+        for (uint32_t family = 0; family < queueFamilyCount; family++)
+        {
+            const VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if (queueFamilies[family].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+                continue;
+
+            if (!indices.transferFamilyHasValue || !(flags & VK_QUEUE_COMPUTE_BIT))
+            {
+                indices.transferFamily = family;
+                indices.transferFamilyHasValue = true;
+            }
+        }
+        if (!indices.transferFamilyHasValue && indices.graphicsFamilyHasValue)
+        {
+            indices.transferFamily = indices.graphicsFamily; // graphics queues can always transfer
+            indices.transferFamilyHasValue = true;
+        }
+
         return indices;
     }
 
@@ -478,7 +538,8 @@ namespace huhu
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer &buffer,
-        VkDeviceMemory &bufferMemory)
+        MemoryAllocation &bufferMemory,
+        bool shareWithTransferQueue)
     {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -486,6 +547,21 @@ namespace huhu
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+        QueueFamilyIndices indices{};
+        uint32_t queueFamilies[2];
+        if (shareWithTransferQueue)
+        {
+            indices = findPhysicalQueueFamilies();
+            if (indices.transferFamily != indices.graphicsFamily)
+            {
+                queueFamilies[0] = indices.graphicsFamily;
+                queueFamilies[1] = indices.transferFamily;
+                bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+                bufferInfo.queueFamilyIndexCount = 2;
+                bufferInfo.pQueueFamilyIndices = queueFamilies;
+            }
+        }
+
         if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create vertex buffer!");
@@ -494,17 +570,59 @@ namespace huhu
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        MemoryCategory category = MemoryCategory::Other;
+        if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+            category = MemoryCategory::Vertex;
+        else if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+            category = MemoryCategory::Index;
+        else if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+            category = MemoryCategory::Uniform;
+        else if (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+            category = MemoryCategory::Staging;
+
+        const uint32_t memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        bufferMemory = allocator->allocate(memRequirements, memoryTypeIndex, false, category);
 
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+        vkBindBufferMemory(device_, buffer, bufferMemory.memory, bufferMemory.offset);
+    }
+
+    MemoryStats HuhuDevice::getMemoryStats()
+    {
+        MemoryStats stats = allocator->getStats();
+        if (!memoryBudgetSupported)
         {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
+            for (auto &heap : stats.heaps)
+            {
+                heap.budget = heap.size;
+                heap.usage = heap.reservedBytes;
+            }
+            return stats;
         }
 
-        vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+        memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties.pNext = &budgetProperties;
+        getPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+        stats.budgetAvailable = true;
+        for (size_t i = 0; i < stats.heaps.size(); i++)
+        {
+            stats.heaps[i].budget = budgetProperties.heapBudget[i];
+            stats.heaps[i].usage = budgetProperties.heapUsage[i];
+        }
+        return stats;
+    }
+
+    bool HuhuDevice::isUploadComplete(UploadToken token)
+    {
+        return stagingRing_->isComplete(token.ticket);
+    }
+
+    void HuhuDevice::waitForUpload(UploadToken token)
+    {
+        stagingRing_->wait(token.ticket);
     }
 
     VkCommandBuffer HuhuDevice::beginSingleTimeCommands()
@@ -586,7 +704,7 @@ namespace huhu
         const VkImageCreateInfo &imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage &image,
-        VkDeviceMemory &imageMemory)
+        MemoryAllocation &imageMemory)
     {
         if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
         {
@@ -596,17 +714,36 @@ namespace huhu
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+        // Transient attachments only ever live in tile memory on tilers, lazily allocated memory for them is then
+        // never actually committed. Desktop GPUs don't have such a type and get the regular one.
+        uint32_t memoryTypeIndex = UINT32_MAX;
+        if (imageInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
         {
-            throw std::runtime_error("failed to allocate image memory!");
+            const VkMemoryPropertyFlags lazyProperties = properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+            VkPhysicalDeviceMemoryProperties memProperties;
+            vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+            for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+            {
+                if ((memRequirements.memoryTypeBits & (1 << i)) &&
+                    (memProperties.memoryTypes[i].propertyFlags & lazyProperties) == lazyProperties)
+                {
+                    memoryTypeIndex = i;
+                    break;
+                }
+            }
         }
+        if (memoryTypeIndex == UINT32_MAX)
+            memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+        // optimal tiling images live in blocks of their own, so bufferImageGranularity never comes into play
+        MemoryCategory category = MemoryCategory::Other;
+        if (imageInfo.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            category = MemoryCategory::Depth;
+        else if (imageInfo.usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+            category = MemoryCategory::Texture;
+        imageMemory = allocator->allocate(memRequirements, memoryTypeIndex, imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL, category);
 
-        if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS)
+        if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to bind image memory!");
         }
@@ -1,15 +1,19 @@
 #pragma once
 
+#include "huhu_deletion_queue.hpp"
+#include "huhu_memory_allocator.hpp"
 #include "huhu_window.hpp"
 
 #include <vulkan/vulkan_beta.h> // only beta header supports VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME which is needed for proper M1 support 
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace huhu
 {
+    class HuhuStagingRing;
 
     struct SwapChainSupportDetails
     {
@@ -18,12 +22,20 @@ namespace huhu
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+    // Completion token of an upload batch (see HuhuUploadBatch), batches complete in submission order.
+    struct UploadToken
+    {
+        uint64_t ticket = 0; // staging ring ticket, 0 for a batch that had nothing to submit
+    };
+
     struct QueueFamilyIndices
     {
         uint32_t graphicsFamily;
         uint32_t presentFamily;
+        uint32_t transferFamily; // a transfer-only family if there is one, the graphics family otherwise
         bool graphicsFamilyHasValue = false;
         bool presentFamilyHasValue = false;
+        bool transferFamilyHasValue = false;
         bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
     };
 
@@ -50,6 +62,10 @@ namespace huhu
         VkSurfaceKHR surface() { return surface_; }
         VkQueue graphicsQueue() { return graphicsQueue_; }
         VkQueue presentQueue() { return presentQueue_; }
+        VkQueue transferQueue() { return transferQueue_; } // same queue as graphicsQueue() without a dedicated family
+        HuhuStagingRing &stagingRing() { return *stagingRing_; }
+        // for destroying anything a frame in flight might still use
+        HuhuDeletionQueue &deletionQueue() { return deletionQueue_; }
 
         SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -57,13 +73,22 @@ namespace huhu
         VkFormat findSupportedFormat(
             const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+        // allocator bookkeeping plus budget and usage per heap, from VK_EXT_memory_budget when the device has it
+        MemoryStats getMemoryStats();
+
+        bool isUploadComplete(UploadToken token);
+        void waitForUpload(UploadToken token);
+
         // Buffer Helper Functions
         void createBuffer(
             VkDeviceSize size,
             VkBufferUsageFlags usage,
             VkMemoryPropertyFlags properties,
             VkBuffer &buffer,
-            VkDeviceMemory &bufferMemory);
+            MemoryAllocation &bufferMemory,
+            bool shareWithTransferQueue = false); // concurrent sharing, for buffers both queues use at the same time
+        // Single time commands drain the whole graphics queue per call, fine for tools but use HuhuUploadBatch for
+        // anything that runs while rendering.
         VkCommandBuffer beginSingleTimeCommands();
         void endSingleTimeCommands(VkCommandBuffer commandBuffer);
         void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -74,9 +99,21 @@ namespace huhu
             const VkImageCreateInfo &imageInfo,
             VkMemoryPropertyFlags properties,
             VkImage &image,
-            VkDeviceMemory &imageMemory);
+            MemoryAllocation &imageMemory);
+
+        // memory from createBuffer / createImageWithInfo goes back here, after the buffer or image is destroyed
+        void freeMemory(const MemoryAllocation &memory) { allocator->free(memory); }
+        VkMappedMemoryRange getMappedRange(const MemoryAllocation &memory, VkDeviceSize offset, VkDeviceSize size) const
+        {
+            return allocator->getMappedRange(memory, offset, size);
+        }
+        // host writes to non coherent memory are collected and flushed together once per frame by the renderer,
+        // see HuhuMemoryAllocator::markDirty
+        void markDirty(const MemoryAllocation &memory, VkDeviceSize offset, VkDeviceSize size) { allocator->markDirty(memory, offset, size); }
+        VkResult flushDirtyRanges() { return allocator->flushDirtyRanges(); }
 
         VkPhysicalDeviceProperties properties;
+        VkPhysicalDeviceFeatures enabledFeatures{}; // what the logical device was created with
 
     private:
         void createInstance();
@@ -94,6 +131,7 @@ namespace huhu
         void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
         void hasGflwRequiredInstanceExtensions();
         bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+        bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName);
         SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
         VkInstance instance;
@@ -106,6 +144,13 @@ namespace huhu
         VkSurfaceKHR surface_;
         VkQueue graphicsQueue_;
         VkQueue presentQueue_;
+        VkQueue transferQueue_;
+
+        std::unique_ptr<HuhuMemoryAllocator> allocator;
+        bool memoryBudgetSupported = false;
+        PFN_vkGetPhysicalDeviceMemoryProperties2KHR getPhysicalDeviceMemoryProperties2 = nullptr;
+        std::unique_ptr<HuhuStagingRing> stagingRing_;
+        HuhuDeletionQueue deletionQueue_;
 
         const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
         const std::vector<const char *> deviceExtensions = {
@@ -0,0 +1,65 @@
+#include "huhu_frame_arena.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace huhu
+{
+    void *HuhuFrameArena::allocate(size_t size, size_t alignment)
+    {
+        assert((alignment & (alignment - 1)) == 0 && "alignment has to be a power of two");
+
+        while (currentBlock < blocks.size())
+        {
+            const uintptr_t base = reinterpret_cast<uintptr_t>(blocks[currentBlock].memory.get());
+            const uintptr_t aligned = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+            if (aligned + size <= base + blocks[currentBlock].size)
+            {
+                offset = aligned + size - base;
+                return reinterpret_cast<void *>(aligned);
+            }
+
+            // doesn't fit, move on to the next block we already have
+            currentBlock++;
+            offset = 0;
+        }
+
+        // grow, big allocations get a block of their own size
+        const size_t newBlockSize = std::max(blockSize, size + alignment);
+        blocks.push_back({std::make_unique<std::byte[]>(newBlockSize), newBlockSize});
+        currentBlock = blocks.size() - 1;
+
+        const uintptr_t base = reinterpret_cast<uintptr_t>(blocks[currentBlock].memory.get());
+        const uintptr_t aligned = (base + alignment - 1) & ~uintptr_t(alignment - 1);
+        offset = aligned + size - base;
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    void HuhuFrameArena::reset()
+    {
+        currentBlock = 0;
+        offset = 0;
+    }
+
+    size_t HuhuFrameArena::getUsedBytes() const
+    {
+        size_t used = offset;
+        for (size_t i = 0; i < currentBlock && i < blocks.size(); i++)
+        {
+            used += blocks[i].size; // counts what was skipped at the end of full blocks too
+        }
+        return used;
+    }
+
+    size_t HuhuFrameArena::getCapacity() const
+    {
+        size_t capacity = 0;
+        for (const auto &block : blocks)
+        {
+            capacity += block.size;
+        }
+        return capacity;
+    }
+}
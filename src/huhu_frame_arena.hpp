@@ -0,0 +1,92 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace huhu
+{
+    // Bump allocator for scratch data that only lives for one frame, like visibility and draw lists. Allocating is a
+    // pointer bump and everything is released at once by reset(), nothing is freed or destroyed individually. Blocks
+    // are kept across resets, so once the arena has grown to a frame's needs there are no more mallocs. Not thread
+    // safe, give every recording thread its own.
+    class HuhuFrameArena
+    {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+        explicit HuhuFrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize{blockSize} {}
+
+        HuhuFrameArena(const HuhuFrameArena &) = delete;
+        HuhuFrameArena &operator=(const HuhuFrameArena &) = delete;
+
+        void *allocate(size_t size, size_t alignment);
+
+        // uninitialized storage for count Ts
+        template <typename T>
+        T *allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+            return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        }
+
+        template <typename T, typename... Args>
+        T *create(Args &&...args)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+        }
+
+        // everything allocated so far is gone after this
+        void reset();
+
+        size_t getUsedBytes() const;
+        size_t getCapacity() const;
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<std::byte[]> memory;
+            size_t size;
+        };
+
+        size_t blockSize;
+        std::vector<Block> blocks{};
+        size_t currentBlock = 0;
+        size_t offset = 0; // into blocks[currentBlock]
+    };
+
+    // Lets standard containers allocate from a frame arena. Deallocation does nothing, so reserve up front where the
+    // size is known, otherwise every regrowth leaves the old storage behind until the reset.
+    template <typename T>
+    class FrameAllocator
+    {
+    public:
+        using value_type = T;
+
+        FrameAllocator(HuhuFrameArena &arena) noexcept : arena{&arena} {}
+        template <typename U>
+        FrameAllocator(const FrameAllocator<U> &other) noexcept : arena{other.arena} {}
+
+        T *allocate(size_t count) { return static_cast<T *>(arena->allocate(sizeof(T) * count, alignof(T))); }
+        void deallocate(T *, size_t) noexcept {}
+
+        template <typename U>
+        bool operator==(const FrameAllocator<U> &other) const noexcept { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const FrameAllocator<U> &other) const noexcept { return arena != other.arena; }
+
+    private:
+        template <typename U>
+        friend class FrameAllocator;
+
+        HuhuFrameArena *arena;
+    };
+
+    template <typename T>
+    using FrameVector = std::vector<T, FrameAllocator<T>>;
+}
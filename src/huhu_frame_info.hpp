@@ -1,7 +1,9 @@
 #pragma once
 
 #include "huhu_camera.hpp"
+#include "huhu_frame_arena.hpp"
 #include "huhu_game_object.hpp"
+#include "huhu_uniform_ring.hpp"
 
 // lib
 #include <vulkan/vulkan.h>
@@ -32,6 +34,9 @@ namespace huhu
         VkCommandBuffer commandBuffer;
         HuhuCamera &camera;
         VkDescriptorSet globalDescriptorSet;
+        uint32_t globalUboOffset; // dynamic offset of this frame's GlobalUbo in the uniform ring
         HuhuGameObject::Map &gameObjects;
+        HuhuUniformRing &uniformRing; // for any other per frame uniform data
+        HuhuFrameArena &frameArena;   // cpu scratch that only has to live until the frame is recorded
     };
 }
\ No newline at end of file
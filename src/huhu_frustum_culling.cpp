@@ -0,0 +1,148 @@
+#include "huhu_frustum_culling.hpp"
+
+// std
+#include <cstring>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define HUHU_CULL_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define HUHU_CULL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace huhu
+{
+    // plain version for the leftovers at the end and for cpus without any of the vector paths
+    static void cullSpheresScalar(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint32_t first, uint64_t *visibility)
+    {
+        for (uint32_t i = first; i < spheres.count; i++)
+        {
+            bool inside = true;
+            for (const auto &plane : planes)
+            {
+                const float distance = plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w;
+                inside = inside && distance >= -spheres.radius[i];
+            }
+            visibility[i / 64] |= uint64_t(inside) << (i % 64);
+        }
+    }
+
+#if defined(HUHU_CULL_X86)
+    // Built for AVX2 on its own and only called if the cpu has it, so the rest of the engine doesn't need -mavx2.
+    // Returns how many spheres it got through, the rest is for the scalar loop.
+    __attribute__((target("avx2"))) static uint32_t cullSpheresAvx2(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint64_t *visibility)
+    {
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = _mm256_set1_ps(planes[p].x);
+            planeY[p] = _mm256_set1_ps(planes[p].y);
+            planeZ[p] = _mm256_set1_ps(planes[p].z);
+            planeW[p] = _mm256_set1_ps(planes[p].w);
+        }
+
+        uint32_t i = 0;
+        for (; i + 8 <= spheres.count; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(spheres.centerX + i);
+            const __m256 y = _mm256_loadu_ps(spheres.centerY + i);
+            const __m256 z = _mm256_loadu_ps(spheres.centerZ + i);
+            const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius + i));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_mul_ps(planeX[p], x), planeW[p]);
+                distance = _mm256_add_ps(_mm256_mul_ps(planeY[p], y), distance);
+                distance = _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), distance);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+            // groups of 8 never straddle a word
+            visibility[i / 64] |= uint64_t(_mm256_movemask_ps(inside)) << (i % 64);
+        }
+        return i;
+    }
+
+    static uint32_t cullSpheresSse2(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint64_t *visibility)
+    {
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+        }
+
+        uint32_t i = 0;
+        for (; i + 4 <= spheres.count; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(spheres.centerX + i);
+            const __m128 y = _mm_loadu_ps(spheres.centerY + i);
+            const __m128 z = _mm_loadu_ps(spheres.centerZ + i);
+            const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(planeX[p], x), planeW[p]);
+                distance = _mm_add_ps(_mm_mul_ps(planeY[p], y), distance);
+                distance = _mm_add_ps(_mm_mul_ps(planeZ[p], z), distance);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+            visibility[i / 64] |= uint64_t(_mm_movemask_ps(inside)) << (i % 64);
+        }
+        return i;
+    }
+#elif defined(HUHU_CULL_NEON)
+    static uint32_t cullSpheresNeon(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint64_t *visibility)
+    {
+        float32x4_t planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = vdupq_n_f32(planes[p].x);
+            planeY[p] = vdupq_n_f32(planes[p].y);
+            planeZ[p] = vdupq_n_f32(planes[p].z);
+            planeW[p] = vdupq_n_f32(planes[p].w);
+        }
+        const uint32_t laneBits[4] = {1, 2, 4, 8};
+        const uint32x4_t bits = vld1q_u32(laneBits);
+
+        uint32_t i = 0;
+        for (; i + 4 <= spheres.count; i += 4)
+        {
+            const float32x4_t x = vld1q_f32(spheres.centerX + i);
+            const float32x4_t y = vld1q_f32(spheres.centerY + i);
+            const float32x4_t z = vld1q_f32(spheres.centerZ + i);
+            const float32x4_t negativeRadius = vnegq_f32(vld1q_f32(spheres.radius + i));
+
+            uint32x4_t inside = vdupq_n_u32(~0u);
+            for (int p = 0; p < 6; p++)
+            {
+                float32x4_t distance = vmlaq_f32(planeW[p], planeX[p], x);
+                distance = vmlaq_f32(distance, planeY[p], y);
+                distance = vmlaq_f32(distance, planeZ[p], z);
+                inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+            }
+            // no movemask on neon, pick one bit per lane and add them up
+            visibility[i / 64] |= uint64_t(vaddvq_u32(vandq_u32(inside, bits))) << (i % 64);
+        }
+        return i;
+    }
+#endif
+
+    void cullSpheres(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint64_t *visibility)
+    {
+        memset(visibility, 0, sizeof(uint64_t) * ((spheres.count + 63) / 64));
+
+        uint32_t done = 0;
+#if defined(HUHU_CULL_X86)
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        done = hasAvx2 ? cullSpheresAvx2(planes, spheres, visibility) : cullSpheresSse2(planes, spheres, visibility);
+#elif defined(HUHU_CULL_NEON)
+        done = cullSpheresNeon(planes, spheres, visibility);
+#endif
+        cullSpheresScalar(planes, spheres, done, visibility);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstdint>
+
+namespace huhu
+{
+    // World space bounding spheres as separate arrays, so the culling kernel can load a whole register of each
+    // component at once. The arrays belong to whoever fills them, usually the frame arena.
+    struct BoundingSpheresSoA
+    {
+        float *centerX;
+        float *centerY;
+        float *centerZ;
+        float *radius;
+        uint32_t count;
+    };
+
+    // Tests every sphere against the planes (see HuhuCamera::getFrustumPlanes), bit i of visibility is set if sphere
+    // i is at least partly inside. visibility needs room for (count + 63) / 64 words. Runs 8 spheres at a time with
+    // AVX2 where the cpu has it, 4 at a time with SSE2 or NEON otherwise.
+    void cullSpheres(const std::array<glm::vec4, 6> &planes, const BoundingSpheresSoA &spheres, uint64_t *visibility);
+
+    inline bool isVisible(const uint64_t *visibility, uint32_t index)
+    {
+        return (visibility[index / 64] >> (index % 64)) & 1;
+    }
+}
@@ -0,0 +1,125 @@
+#include "huhu_geometry_arena.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+
+namespace huhu
+{
+    HuhuGeometryArena::HuhuGeometryArena(HuhuDevice &device, VkDeviceSize vertexPoolSize, VkDeviceSize indexPoolSize)
+        : huhuDevice{device}, vertexPoolSize{vertexPoolSize}, indexPoolSize{indexPoolSize} {}
+
+    HuhuGeometryArena::~HuhuGeometryArena()
+    {
+        // models hand their ranges back through the deletion queue, those frees have to happen while we're alive.
+        // the device is idle by now, nothing else could destroy the pools right away either
+        huhuDevice.deletionQueue().flush();
+        for (auto &pool : pools)
+        {
+            vkDestroyBuffer(huhuDevice.device(), pool->buffer, nullptr);
+            huhuDevice.freeMemory(pool->memory);
+        }
+    }
+
+    bool HuhuGeometryArena::allocateVertices(uint32_t vertexStride, uint32_t vertexCount, GeometryRange &range)
+    {
+        return allocate(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexStride, vertexPoolSize, vertexCount, range);
+    }
+
+    bool HuhuGeometryArena::allocateIndices(VkIndexType indexType, uint32_t indexCount, GeometryRange &range)
+    {
+        const uint32_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        return allocate(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexSize, indexPoolSize, indexCount, range);
+    }
+
+    bool HuhuGeometryArena::allocate(VkBufferUsageFlags usage, uint32_t elementSize, VkDeviceSize poolSize, uint32_t count, GeometryRange &range)
+    {
+        std::lock_guard<std::mutex> lock{poolsMutex};
+
+        uint32_t poolIndex = 0;
+        while (poolIndex < pools.size() && (pools[poolIndex]->usage != usage || pools[poolIndex]->elementSize != elementSize))
+            poolIndex++;
+
+        if (poolIndex == pools.size())
+        {
+            auto pool = std::make_unique<Pool>();
+            pool->usage = usage;
+            pool->elementSize = elementSize;
+            pool->capacity = static_cast<uint32_t>(std::min<VkDeviceSize>(poolSize / elementSize, std::numeric_limits<uint32_t>::max()));
+            huhuDevice.createBuffer(
+                VkDeviceSize{pool->capacity} * elementSize,
+                usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                pool->buffer,
+                pool->memory,
+                true); // uploads land on the transfer queue while frames keep reading other ranges
+            pool->freeRanges.emplace(0, pool->capacity);
+            pools.push_back(std::move(pool));
+        }
+
+        // first fit, meshes come and go in big chunks so fragmentation stays manageable
+        Pool &pool = *pools[poolIndex];
+        for (auto it = pool.freeRanges.begin(); it != pool.freeRanges.end(); ++it)
+        {
+            if (it->second < count)
+                continue;
+
+            range.pool = poolIndex;
+            range.first = it->first;
+            range.count = count;
+
+            const uint32_t remaining = it->second - count;
+            pool.freeRanges.erase(it);
+            if (remaining > 0)
+                pool.freeRanges.emplace(range.first + count, remaining);
+            return true;
+        }
+        return false;
+    }
+
+    void HuhuGeometryArena::free(const GeometryRange &range)
+    {
+        std::lock_guard<std::mutex> lock{poolsMutex};
+        assert(range.pool < pools.size() && "range doesn't belong to this arena");
+
+        auto &freeRanges = pools[range.pool]->freeRanges;
+        auto inserted = freeRanges.emplace(range.first, range.count).first;
+
+        // merge with the free neighbours on both sides
+        auto next = std::next(inserted);
+        if (next != freeRanges.end() && inserted->first + inserted->second == next->first)
+        {
+            inserted->second += next->second;
+            freeRanges.erase(next);
+        }
+        if (inserted != freeRanges.begin())
+        {
+            auto previous = std::prev(inserted);
+            if (previous->first + previous->second == inserted->first)
+            {
+                previous->second += inserted->second;
+                freeRanges.erase(inserted);
+            }
+        }
+    }
+
+    VkBuffer HuhuGeometryArena::getBuffer(const GeometryRange &range) const
+    {
+        std::lock_guard<std::mutex> lock{poolsMutex};
+        return pools[range.pool]->buffer;
+    }
+
+    VkDeviceSize HuhuGeometryArena::getByteOffset(const GeometryRange &range) const
+    {
+        std::lock_guard<std::mutex> lock{poolsMutex};
+        return VkDeviceSize{range.first} * pools[range.pool]->elementSize;
+    }
+
+    VkDeviceSize HuhuGeometryArena::getByteSize(const GeometryRange &range) const
+    {
+        std::lock_guard<std::mutex> lock{poolsMutex};
+        return VkDeviceSize{range.count} * pools[range.pool]->elementSize;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "huhu_device.hpp"
+
+// std
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace huhu
+{
+    // Elements [first, first + count) of one of the arena's buffers.
+    struct GeometryRange
+    {
+        uint32_t pool = 0;
+        uint32_t first = 0; // in vertices or indices, which is what firstIndex / vertexOffset want
+        uint32_t count = 0;
+    };
+
+    // Big shared device local vertex and index buffers that models sub-allocate from, so the renderer only has to
+    // rebind when the vertex layout or index type changes instead of for every object. There's one pool per vertex
+    // stride and index type, each created on first use with a fixed capacity. Allocation can be called from any
+    // thread.
+    class HuhuGeometryArena
+    {
+    public:
+        HuhuGeometryArena(HuhuDevice &device, VkDeviceSize vertexPoolSize = 64ull * 1024 * 1024, VkDeviceSize indexPoolSize = 32ull * 1024 * 1024);
+        ~HuhuGeometryArena();
+
+        HuhuGeometryArena(const HuhuGeometryArena &) = delete;
+        HuhuGeometryArena &operator=(const HuhuGeometryArena &) = delete;
+
+        // return false if the pool is out of space, the caller should use its own buffer then
+        bool allocateVertices(uint32_t vertexStride, uint32_t vertexCount, GeometryRange &range);
+        bool allocateIndices(VkIndexType indexType, uint32_t indexCount, GeometryRange &range);
+        void free(const GeometryRange &range);
+
+        VkBuffer getBuffer(const GeometryRange &range) const;
+        VkDeviceSize getByteOffset(const GeometryRange &range) const;
+        VkDeviceSize getByteSize(const GeometryRange &range) const;
+
+    private:
+        struct Pool
+        {
+            VkBufferUsageFlags usage;
+            uint32_t elementSize;
+            uint32_t capacity; // elements
+            VkBuffer buffer = VK_NULL_HANDLE;
+            MemoryAllocation memory{};
+            std::map<uint32_t, uint32_t> freeRanges{}; // first -> count, neighbours are always merged
+        };
+
+        bool allocate(VkBufferUsageFlags usage, uint32_t elementSize, VkDeviceSize poolSize, uint32_t count, GeometryRange &range);
+
+        HuhuDevice &huhuDevice;
+        VkDeviceSize vertexPoolSize;
+        VkDeviceSize indexPoolSize;
+
+        mutable std::mutex poolsMutex;
+        std::vector<std::unique_ptr<Pool>> pools{};
+    };
+}
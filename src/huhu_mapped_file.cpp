@@ -0,0 +1,52 @@
+#include "huhu_mapped_file.hpp"
+
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// std
+#include <stdexcept>
+
+namespace huhu
+{
+    HuhuMappedFile::HuhuMappedFile(const std::string &filepath)
+    {
+        int fd = open(filepath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("failed to open file: " + filepath);
+        }
+
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("failed to stat file: " + filepath);
+        }
+        fileSize = static_cast<size_t>(fileStat.st_size);
+
+        if (fileSize > 0) // mmap refuses zero length mappings, an empty file just stays unmapped
+        {
+            mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                mapped = nullptr;
+                close(fd);
+                throw std::runtime_error("failed to map file: " + filepath);
+            }
+            madvise(mapped, fileSize, MADV_SEQUENTIAL); // we only ever stream through it once
+        }
+
+        close(fd); // the mapping keeps its own reference to the file
+    }
+
+    HuhuMappedFile::~HuhuMappedFile()
+    {
+        if (mapped)
+        {
+            munmap(mapped, fileSize);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+
+namespace huhu
+{
+    // read-only memory mapping of a whole file, unmapped again on destruction
+    class HuhuMappedFile
+    {
+    public:
+        HuhuMappedFile(const std::string &filepath);
+        ~HuhuMappedFile();
+
+        HuhuMappedFile(const HuhuMappedFile &) = delete;
+        HuhuMappedFile &operator=(const HuhuMappedFile &) = delete;
+
+        const char *data() const { return static_cast<const char *>(mapped); }
+        size_t size() const { return fileSize; }
+
+    private:
+        void *mapped = nullptr;
+        size_t fileSize = 0;
+    };
+}
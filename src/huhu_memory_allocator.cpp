@@ -0,0 +1,561 @@
+#include "huhu_memory_allocator.hpp"
+
+// std
+#include <algorithm>
+#include <functional>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace huhu
+{
+    namespace
+    {
+        double toMiB(VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); }
+
+        uint32_t mostSignificantBit(uint64_t value) { return 63 - static_cast<uint32_t>(__builtin_clzll(value)); }
+        uint32_t leastSignificantBit(uint64_t value) { return static_cast<uint32_t>(__builtin_ctzll(value)); }
+
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) { return (value + alignment - 1) / alignment * alignment; }
+    }
+
+    HuhuMemoryAllocator::HuhuMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+        : device{device}, blockSize{blockSize}
+    {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+        stats.heaps.resize(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+        {
+            stats.heaps[i].size = memoryProperties.memoryHeaps[i].size;
+            stats.heaps[i].deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+    }
+
+    HuhuMemoryAllocator::~HuhuMemoryAllocator()
+    {
+        for (auto &block : blocks)
+        {
+            if (block)
+            {
+                assert(block->usedChunkCount == 0 && "memory still in use when destroying the allocator");
+                destroyBlock(*block);
+            }
+        }
+    }
+
+    MemoryAllocation HuhuMemoryAllocator::allocate(const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, bool optimalImage, MemoryCategory category)
+    {
+        VkDeviceSize size = requirements.size;
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        if (needsAtomAlignment(memoryTypeIndex))
+        {
+            // widened flush and invalidate ranges then never reach into a neighbour
+            size = alignUp(size, nonCoherentAtomSize);
+            alignment = std::max(alignment, nonCoherentAtomSize);
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto finish = [&](MemoryAllocation allocation)
+        {
+            allocation.category = category;
+            track(allocation, true);
+            return allocation;
+        };
+
+        // small heaps (integrated or BAR memory) get smaller blocks so a single one can't eat most of the heap
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+        const VkDeviceSize preferredBlockSize = std::min(blockSize, heapSize / 8);
+        // lazily allocated memory is committed per VkDeviceMemory, sharing a block would defeat it
+        const bool lazy = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        if (size > preferredBlockSize / 2 || lazy)
+            return finish(allocateDedicated(size, memoryTypeIndex));
+
+        auto fill = [&](uint32_t blockIndex, uint32_t chunk)
+        {
+            const Block &block = *blocks[blockIndex];
+            MemoryAllocation allocation{};
+            allocation.memory = block.memory;
+            allocation.offset = block.chunks[chunk].offset;
+            allocation.size = size;
+            allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + allocation.offset : nullptr;
+            allocation.memoryTypeIndex = memoryTypeIndex;
+            allocation.block = blockIndex;
+            allocation.chunk = chunk;
+            return finish(allocation);
+        };
+
+        for (uint32_t i = 0; i < blocks.size(); i++)
+        {
+            Block *block = blocks[i].get();
+            if (!block || block->memoryTypeIndex != memoryTypeIndex || block->optimalImage != optimalImage)
+                continue;
+
+            uint32_t chunk;
+            if (allocateFromBlock(*block, size, alignment, chunk))
+                return fill(i, chunk);
+        }
+
+        auto block = createBlock(memoryTypeIndex, optimalImage);
+        if (!block)
+            return finish(allocateDedicated(size, memoryTypeIndex)); // out of room for a whole block, try just this one
+
+        uint32_t chunk;
+        const bool allocated = allocateFromBlock(*block, size, alignment, chunk);
+        assert(allocated && "fresh block should fit anything below half its size");
+
+        auto emptySlot = std::find(blocks.begin(), blocks.end(), nullptr);
+        const uint32_t blockIndex = static_cast<uint32_t>(emptySlot - blocks.begin());
+        if (emptySlot == blocks.end())
+            blocks.push_back(std::move(block));
+        else
+            *emptySlot = std::move(block);
+        return fill(blockIndex, chunk);
+    }
+
+    void HuhuMemoryAllocator::free(const MemoryAllocation &allocation)
+    {
+        if (allocation.memory == VK_NULL_HANDLE)
+            return;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        track(allocation, false);
+
+        if (allocation.block == MemoryAllocation::DEDICATED)
+        {
+            vkFreeMemory(device, allocation.memory, nullptr); // implicitly unmapped
+            return;
+        }
+
+        Block &block = *blocks[allocation.block];
+        freeToBlock(block, allocation.chunk);
+        if (block.usedChunkCount > 0)
+            return;
+
+        // keep one empty block per kind around, so allocating and freeing in a loop doesn't churn device memory
+        const bool hasSibling = std::any_of(blocks.begin(), blocks.end(), [&](const auto &other)
+                                            { return other && other.get() != &block && other->memoryTypeIndex == block.memoryTypeIndex &&
+                                                     other->optimalImage == block.optimalImage; });
+        if (hasSibling)
+        {
+            destroyBlock(block);
+            blocks[allocation.block].reset();
+        }
+    }
+
+    MemoryStats HuhuMemoryAllocator::getStats() const
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return stats;
+    }
+
+    void HuhuMemoryAllocator::track(const MemoryAllocation &allocation, bool allocated)
+    {
+        MemoryStats::Heap &heap = stats.heaps[memoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex];
+        MemoryStats::Category &category = stats.categories[static_cast<size_t>(allocation.category)];
+        if (allocated)
+        {
+            heap.allocatedBytes += allocation.size;
+            heap.allocationCount++;
+            category.allocatedBytes += allocation.size;
+            category.allocationCount++;
+            if (allocation.block == MemoryAllocation::DEDICATED)
+                heap.reservedBytes += allocation.size;
+        }
+        else
+        {
+            heap.allocatedBytes -= allocation.size;
+            heap.allocationCount--;
+            category.allocatedBytes -= allocation.size;
+            category.allocationCount--;
+            if (allocation.block == MemoryAllocation::DEDICATED)
+                heap.reservedBytes -= allocation.size;
+        }
+    }
+
+    VkMappedMemoryRange HuhuMemoryAllocator::getMappedRange(const MemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const
+    {
+        if (size == VK_WHOLE_SIZE)
+            size = allocation.size - offset;
+
+        VkDeviceSize memorySize = allocation.size;
+        if (allocation.block != MemoryAllocation::DEDICATED)
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            memorySize = blocks[allocation.block]->size;
+        }
+
+        // Ranges have to be atom aligned or end at the end of the memory. Non coherent allocations are atom aligned
+        // themselves so this never reaches into a neighbour, for coherent ones it wouldn't matter if it did.
+        const VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+        const VkDeviceSize end = std::min(alignUp(allocation.offset + offset + size, nonCoherentAtomSize), memorySize);
+
+        VkMappedMemoryRange mappedRange = {};
+        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        mappedRange.memory = allocation.memory;
+        mappedRange.offset = begin;
+        mappedRange.size = end - begin;
+        return mappedRange;
+    }
+
+    void HuhuMemoryAllocator::markDirty(const MemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!needsAtomAlignment(allocation.memoryTypeIndex))
+            return;
+
+        const VkMappedMemoryRange range = getMappedRange(allocation, offset, size);
+        std::lock_guard<std::mutex> lock{mutex};
+        dirtyRanges.push_back(range);
+    }
+
+    VkResult HuhuMemoryAllocator::flushDirtyRanges()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (dirtyRanges.empty())
+            return VK_SUCCESS;
+
+        // One range per block spanning everything written to it. Flushing the clean bytes in between is harmless and
+        // cheaper than handing the driver lots of little ranges.
+        std::sort(
+            dirtyRanges.begin(),
+            dirtyRanges.end(),
+            [](const VkMappedMemoryRange &a, const VkMappedMemoryRange &b)
+            {
+                if (a.memory != b.memory)
+                    return std::less<VkDeviceMemory>{}(a.memory, b.memory);
+                return a.offset < b.offset;
+            });
+
+        size_t merged = 0;
+        for (size_t i = 1; i < dirtyRanges.size(); i++)
+        {
+            VkMappedMemoryRange &last = dirtyRanges[merged];
+            const VkMappedMemoryRange &range = dirtyRanges[i];
+            if (range.memory == last.memory)
+            {
+                last.size = std::max(last.size, range.offset + range.size - last.offset);
+                continue;
+            }
+            dirtyRanges[++merged] = range;
+        }
+
+        const VkResult result = vkFlushMappedMemoryRanges(device, static_cast<uint32_t>(merged + 1), dirtyRanges.data());
+        dirtyRanges.clear();
+        return result;
+    }
+
+    bool HuhuMemoryAllocator::needsAtomAlignment(uint32_t memoryTypeIndex) const
+    {
+        const VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+        return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
+    std::unique_ptr<HuhuMemoryAllocator::Block> HuhuMemoryAllocator::createBlock(uint32_t memoryTypeIndex, bool optimalImage)
+    {
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+        auto block = std::make_unique<Block>();
+        block->size = std::min(blockSize, heapSize / 8);
+        block->memoryTypeIndex = memoryTypeIndex;
+        block->optimalImage = optimalImage;
+        std::fill(&block->freeHeads[0][0], &block->freeHeads[0][0] + FL_COUNT * SL_COUNT, NONE);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block->size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+            return nullptr;
+
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            // a VkDeviceMemory can only be mapped once, so the whole block stays mapped for everyone in it
+            if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+            {
+                vkFreeMemory(device, block->memory, nullptr);
+                return nullptr;
+            }
+        }
+
+        MemoryStats::Heap &heap = stats.heaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+        heap.reservedBytes += block->size;
+        heap.blockCount++;
+
+        const uint32_t chunk = newChunk(*block);
+        block->chunks[chunk].offset = 0;
+        block->chunks[chunk].size = block->size;
+        insertFree(*block, chunk);
+        return block;
+    }
+
+    void HuhuMemoryAllocator::destroyBlock(Block &block)
+    {
+        MemoryStats::Heap &heap = stats.heaps[memoryProperties.memoryTypes[block.memoryTypeIndex].heapIndex];
+        heap.reservedBytes -= block.size;
+        heap.blockCount--;
+        vkFreeMemory(device, block.memory, nullptr);
+    }
+
+    MemoryAllocation HuhuMemoryAllocator::allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex)
+    {
+        MemoryAllocation allocation{};
+        allocation.size = size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            if (vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped) != VK_SUCCESS)
+            {
+                vkFreeMemory(device, allocation.memory, nullptr);
+                throw std::runtime_error("failed to map device memory!");
+            }
+        }
+        return allocation;
+    }
+
+    void HuhuMemoryAllocator::mapping(VkDeviceSize size, uint32_t &fl, uint32_t &sl)
+    {
+        if (size < SL_COUNT)
+        {
+            // tiny sizes get one list each in the first row
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+        const uint32_t msb = mostSignificantBit(size);
+        sl = static_cast<uint32_t>(size >> (msb - SL_BITS)) ^ SL_COUNT;
+        fl = msb - SL_BITS + 1;
+    }
+
+    uint32_t HuhuMemoryAllocator::newChunk(Block &block)
+    {
+        if (!block.unusedChunks.empty())
+        {
+            const uint32_t chunk = block.unusedChunks.back();
+            block.unusedChunks.pop_back();
+            block.chunks[chunk] = Chunk{};
+            return chunk;
+        }
+        block.chunks.push_back(Chunk{});
+        return static_cast<uint32_t>(block.chunks.size() - 1);
+    }
+
+    void HuhuMemoryAllocator::insertFree(Block &block, uint32_t chunk)
+    {
+        uint32_t fl, sl;
+        mapping(block.chunks[chunk].size, fl, sl);
+
+        Chunk &entry = block.chunks[chunk];
+        entry.free = true;
+        entry.prevFree = NONE;
+        entry.nextFree = block.freeHeads[fl][sl];
+        if (entry.nextFree != NONE)
+            block.chunks[entry.nextFree].prevFree = chunk;
+        block.freeHeads[fl][sl] = chunk;
+
+        block.flBitmap |= 1ull << fl;
+        block.slBitmap[fl] |= 1u << sl;
+    }
+
+    void HuhuMemoryAllocator::removeFree(Block &block, uint32_t chunk)
+    {
+        uint32_t fl, sl;
+        mapping(block.chunks[chunk].size, fl, sl);
+
+        Chunk &entry = block.chunks[chunk];
+        if (entry.prevFree != NONE)
+            block.chunks[entry.prevFree].nextFree = entry.nextFree;
+        else
+            block.freeHeads[fl][sl] = entry.nextFree;
+        if (entry.nextFree != NONE)
+            block.chunks[entry.nextFree].prevFree = entry.prevFree;
+
+        if (block.freeHeads[fl][sl] == NONE)
+        {
+            block.slBitmap[fl] &= ~(1u << sl);
+            if (block.slBitmap[fl] == 0)
+                block.flBitmap &= ~(1ull << fl);
+        }
+        entry.free = false;
+    }
+
+    bool HuhuMemoryAllocator::allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, uint32_t &chunk)
+    {
+        // Round the request up to the next list so anything found there is big enough, including the worst case
+        // alignment padding. That's the "good fit" part, no list ever has to be walked.
+        VkDeviceSize searchSize = size + alignment - 1;
+        if (searchSize >= SL_COUNT)
+            searchSize += (VkDeviceSize{1} << (mostSignificantBit(searchSize) - SL_BITS)) - 1;
+        if (searchSize > block.size)
+            return false;
+
+        uint32_t fl, sl;
+        mapping(searchSize, fl, sl);
+
+        uint32_t slMap = block.slBitmap[fl] & (~0u << sl);
+        if (slMap == 0)
+        {
+            const uint64_t flMap = fl + 1 < FL_COUNT ? block.flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap == 0)
+                return false;
+            fl = leastSignificantBit(flMap);
+            slMap = block.slBitmap[fl];
+        }
+        sl = leastSignificantBit(slMap);
+        chunk = block.freeHeads[fl][sl];
+        removeFree(block, chunk);
+
+        // give the alignment padding in front back as its own free chunk
+        const VkDeviceSize alignedOffset = alignUp(block.chunks[chunk].offset, alignment);
+        const VkDeviceSize padding = alignedOffset - block.chunks[chunk].offset;
+        if (padding > 0)
+        {
+            const uint32_t front = chunk;
+            chunk = newChunk(block); // may reallocate chunks, so no references held across this
+            Chunk &frontChunk = block.chunks[front];
+            Chunk &alignedChunk = block.chunks[chunk];
+            alignedChunk.offset = alignedOffset;
+            alignedChunk.size = frontChunk.size - padding;
+            alignedChunk.prevPhysical = front;
+            alignedChunk.nextPhysical = frontChunk.nextPhysical;
+            alignedChunk.free = false;
+            if (frontChunk.nextPhysical != NONE)
+                block.chunks[frontChunk.nextPhysical].prevPhysical = chunk;
+            frontChunk.nextPhysical = chunk;
+            frontChunk.size = padding;
+            insertFree(block, front);
+        }
+
+        // and the tail behind it
+        if (block.chunks[chunk].size > size)
+        {
+            const uint32_t tail = newChunk(block);
+            Chunk &usedChunk = block.chunks[chunk];
+            Chunk &tailChunk = block.chunks[tail];
+            tailChunk.offset = usedChunk.offset + size;
+            tailChunk.size = usedChunk.size - size;
+            tailChunk.prevPhysical = chunk;
+            tailChunk.nextPhysical = usedChunk.nextPhysical;
+            if (usedChunk.nextPhysical != NONE)
+                block.chunks[usedChunk.nextPhysical].prevPhysical = tail;
+            usedChunk.nextPhysical = tail;
+            usedChunk.size = size;
+            insertFree(block, tail);
+        }
+
+        block.usedChunkCount++;
+        return true;
+    }
+
+    void HuhuMemoryAllocator::freeToBlock(Block &block, uint32_t chunk)
+    {
+        assert(!block.chunks[chunk].free && "double free");
+        block.usedChunkCount--;
+
+        // merge with free physical neighbours, there are never two free chunks next to each other
+        const uint32_t next = block.chunks[chunk].nextPhysical;
+        if (next != NONE && block.chunks[next].free)
+        {
+            removeFree(block, next);
+            block.chunks[chunk].size += block.chunks[next].size;
+            block.chunks[chunk].nextPhysical = block.chunks[next].nextPhysical;
+            if (block.chunks[next].nextPhysical != NONE)
+                block.chunks[block.chunks[next].nextPhysical].prevPhysical = chunk;
+            block.unusedChunks.push_back(next);
+        }
+
+        const uint32_t prev = block.chunks[chunk].prevPhysical;
+        if (prev != NONE && block.chunks[prev].free)
+        {
+            removeFree(block, prev);
+            block.chunks[prev].size += block.chunks[chunk].size;
+            block.chunks[prev].nextPhysical = block.chunks[chunk].nextPhysical;
+            if (block.chunks[chunk].nextPhysical != NONE)
+                block.chunks[block.chunks[chunk].nextPhysical].prevPhysical = prev;
+            block.unusedChunks.push_back(chunk);
+            chunk = prev;
+        }
+
+        insertFree(block, chunk);
+    }
+
+    const char *getMemoryCategoryName(MemoryCategory category)
+    {
+        switch (category)
+        {
+        case MemoryCategory::Vertex:
+            return "vertex";
+        case MemoryCategory::Index:
+            return "index";
+        case MemoryCategory::Uniform:
+            return "uniform";
+        case MemoryCategory::Staging:
+            return "staging";
+        case MemoryCategory::Depth:
+            return "depth";
+        case MemoryCategory::Texture:
+            return "texture";
+        default:
+            return "other";
+        }
+    }
+
+    void MemoryStats::log(std::ostream &out) const
+    {
+        out << std::fixed << std::setprecision(1);
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            const Heap &heap = heaps[i];
+            out << "memory heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": "
+                << toMiB(heap.allocatedBytes) << " MiB in " << heap.allocationCount << " allocations, "
+                << toMiB(heap.reservedBytes) << " MiB reserved in " << heap.blockCount << " blocks, "
+                << "usage " << toMiB(heap.usage) << " / " << toMiB(heap.budget) << " MiB"
+                << (budgetAvailable ? "" : " (no budget extension)") << std::endl;
+        }
+        for (size_t i = 0; i < categories.size(); i++)
+        {
+            if (categories[i].allocationCount == 0)
+                continue;
+            out << "memory " << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << ": "
+                << toMiB(categories[i].allocatedBytes) << " MiB in " << categories[i].allocationCount << " allocations" << std::endl;
+        }
+        out << std::defaultfloat;
+    }
+
+    std::string MemoryStats::toJson() const
+    {
+        std::ostringstream json;
+        json << "{\"budgetAvailable\":" << (budgetAvailable ? "true" : "false") << ",\"heaps\":[";
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            const Heap &heap = heaps[i];
+            json << (i > 0 ? "," : "") << "{\"size\":" << heap.size << ",\"budget\":" << heap.budget << ",\"usage\":" << heap.usage
+                 << ",\"reservedBytes\":" << heap.reservedBytes << ",\"allocatedBytes\":" << heap.allocatedBytes
+                 << ",\"blockCount\":" << heap.blockCount << ",\"allocationCount\":" << heap.allocationCount
+                 << ",\"deviceLocal\":" << (heap.deviceLocal ? "true" : "false") << "}";
+        }
+        json << "],\"categories\":{";
+        for (size_t i = 0; i < categories.size(); i++)
+        {
+            json << (i > 0 ? "," : "") << "\"" << getMemoryCategoryName(static_cast<MemoryCategory>(i)) << "\":{\"allocatedBytes\":"
+                 << categories[i].allocatedBytes << ",\"allocationCount\":" << categories[i].allocationCount << "}";
+        }
+        json << "}}";
+        return json.str();
+    }
+}
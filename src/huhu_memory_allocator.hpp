@@ -0,0 +1,164 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace huhu
+{
+    // What an allocation is used for, only for the statistics.
+    enum class MemoryCategory : uint8_t
+    {
+        Vertex,
+        Index,
+        Uniform,
+        Staging,
+        Depth,
+        Texture,
+        Other,
+        Count
+    };
+
+    const char *getMemoryCategoryName(MemoryCategory category);
+
+    struct MemoryStats
+    {
+        struct Heap
+        {
+            VkDeviceSize size = 0;
+            VkDeviceSize budget = 0;         // how much the process should stay below, the heap size without VK_EXT_memory_budget
+            VkDeviceSize usage = 0;          // whole process with VK_EXT_memory_budget, our reserved bytes otherwise
+            VkDeviceSize reservedBytes = 0;  // blocks and dedicated allocations
+            VkDeviceSize allocatedBytes = 0; // handed out to buffers and images
+            uint32_t blockCount = 0;
+            uint32_t allocationCount = 0;
+            bool deviceLocal = false;
+        };
+
+        struct Category
+        {
+            VkDeviceSize allocatedBytes = 0;
+            uint32_t allocationCount = 0;
+        };
+
+        bool budgetAvailable = false;
+        std::vector<Heap> heaps{};
+        std::array<Category, static_cast<size_t>(MemoryCategory::Count)> categories{};
+
+        // one line per heap and non empty category
+        void log(std::ostream &out) const;
+        std::string toJson() const;
+    };
+
+    // Memory backing one buffer or image, either a range of a shared block or a dedicated VkDeviceMemory.
+    struct MemoryAllocation
+    {
+        static constexpr uint32_t DEDICATED = UINT32_MAX;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr; // host visible memory stays mapped for good, this points at offset
+        uint32_t memoryTypeIndex = 0;
+        uint32_t block = DEDICATED;
+        uint32_t chunk = 0;
+        MemoryCategory category = MemoryCategory::Other;
+    };
+
+    // Sub-allocates buffers and images out of big VkDeviceMemory blocks instead of one vkAllocateMemory each, which
+    // is slow and runs into maxMemoryAllocationCount. Every block is managed with TLSF (two level segregated fit),
+    // so allocating and freeing are O(1) with little fragmentation. Optimal tiling images get blocks of their own,
+    // which sidesteps bufferImageGranularity, and anything bigger than half a block gets dedicated memory.
+    class HuhuMemoryAllocator
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+        HuhuMemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+        ~HuhuMemoryAllocator();
+
+        HuhuMemoryAllocator(const HuhuMemoryAllocator &) = delete;
+        HuhuMemoryAllocator &operator=(const HuhuMemoryAllocator &) = delete;
+
+        MemoryAllocation allocate(const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, bool optimalImage, MemoryCategory category);
+        void free(const MemoryAllocation &allocation);
+
+        // our own bookkeeping only, budget and usage are left for the caller (see HuhuDevice::getMemoryStats)
+        MemoryStats getStats() const;
+
+        // the flush/invalidate range for [offset, offset + size) of an allocation, widened to nonCoherentAtomSize
+        VkMappedMemoryRange getMappedRange(const MemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+        // Remembers a host write for flushDirtyRanges(), which coalesces everything marked since the last call into one
+        // range per memory block and flushes them all with one call. Coherent memory is skipped right away.
+        void markDirty(const MemoryAllocation &allocation, VkDeviceSize offset, VkDeviceSize size);
+        VkResult flushDirtyRanges();
+
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+        static constexpr uint32_t SL_BITS = 5;
+        static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+        static constexpr uint32_t FL_COUNT = 64;
+
+        // a free or used range of a block, physical neighbours and free list links are chunk indices
+        struct Chunk
+        {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+            uint32_t prevPhysical = NONE;
+            uint32_t nextPhysical = NONE;
+            uint32_t prevFree = NONE;
+            uint32_t nextFree = NONE;
+            bool free = true;
+        };
+
+        struct Block
+        {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            uint32_t memoryTypeIndex = 0;
+            bool optimalImage = false;
+            void *mapped = nullptr;
+            uint32_t usedChunkCount = 0;
+
+            std::vector<Chunk> chunks{};
+            std::vector<uint32_t> unusedChunks{}; // recycled slots in chunks
+
+            // bit fl is set if any list in row fl is non empty, bit sl of slBitmap[fl] if list (fl, sl) is
+            uint64_t flBitmap = 0;
+            uint32_t slBitmap[FL_COUNT] = {};
+            uint32_t freeHeads[FL_COUNT][SL_COUNT];
+        };
+
+        static void mapping(VkDeviceSize size, uint32_t &fl, uint32_t &sl);
+        static uint32_t newChunk(Block &block);
+        static void insertFree(Block &block, uint32_t chunk);
+        static void removeFree(Block &block, uint32_t chunk);
+        static bool allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, uint32_t &chunk);
+        static void freeToBlock(Block &block, uint32_t chunk);
+
+        bool needsAtomAlignment(uint32_t memoryTypeIndex) const;
+        std::unique_ptr<Block> createBlock(uint32_t memoryTypeIndex, bool optimalImage);
+        void destroyBlock(Block &block);
+        MemoryAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex); // with mutex held
+        void track(const MemoryAllocation &allocation, bool allocated);
+
+        VkDevice device;
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        VkDeviceSize nonCoherentAtomSize;
+        VkDeviceSize blockSize;
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Block>> blocks{}; // freed blocks leave a null slot so indices stay valid
+        MemoryStats stats{};
+        std::vector<VkMappedMemoryRange> dirtyRanges{}; // atom aligned already
+    };
+}
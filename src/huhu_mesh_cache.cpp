@@ -0,0 +1,257 @@
+#include "huhu_mesh_cache.hpp"
+
+// posix
+#include <unistd.h>
+
+// std
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+namespace huhu
+{
+    namespace
+    {
+        constexpr char HMESH_MAGIC[4] = {'H', 'M', 'S', 'H'};
+        constexpr uint64_t HMESH_BLOB_ALIGNMENT = 16;
+
+        struct HmeshHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceSize;
+            int64_t sourceModifiedTime;
+            uint32_t vertexStride; // catches vertex layout changes between builds
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t configFlags; // whatever in ModelConfigInfo changes the baked mesh
+            float boundsMin[3];
+            float boundsMax[3];
+            uint64_t vertexOffset;
+            uint64_t indexOffset;
+            uint32_t submeshCount;
+            uint32_t lodCount;
+            uint64_t submeshOffset;
+            uint64_t lodOffset;
+            uint32_t lodConfigHash; // lodTargetErrors don't fit in configFlags
+            uint32_t meshletCount;
+            uint64_t meshletOffset;
+        };
+
+        struct SourceStamp
+        {
+            uint64_t size;
+            int64_t modifiedTime;
+        };
+
+        bool stampSource(const std::string &sourcePath, SourceStamp &stamp)
+        {
+            std::error_code ec;
+            stamp.size = static_cast<uint64_t>(std::filesystem::file_size(sourcePath, ec));
+            if (ec)
+                return false;
+
+            auto modified = std::filesystem::last_write_time(sourcePath, ec);
+            if (ec)
+                return false;
+            stamp.modifiedTime = static_cast<int64_t>(modified.time_since_epoch().count());
+            return true;
+        }
+
+        uint32_t configFlagsFor(const ModelConfigInfo &configInfo)
+        {
+            uint32_t flags = 0;
+            if (configInfo.optimizeMesh)
+                flags |= 1u << 0;
+            if (configInfo.vertexFormat == VertexFormat::Packed)
+                flags |= 1u << 1;
+            if (configInfo.splitSubmeshes)
+                flags |= 1u << 2;
+            if (configInfo.buildMeshlets)
+                flags |= 1u << 3;
+            return flags;
+        }
+
+        uint32_t lodConfigHashFor(const ModelConfigInfo &configInfo)
+        {
+            // FNV-1a over the raw target errors
+            uint32_t hash = 2166136261u;
+            for (float targetError : configInfo.lodTargetErrors)
+            {
+                uint32_t bits;
+                memcpy(&bits, &targetError, sizeof(bits));
+                for (int i = 0; i < 4; i++)
+                {
+                    hash ^= (bits >> (8 * i)) & 0xff;
+                    hash *= 16777619u;
+                }
+            }
+            return hash;
+        }
+
+        uint64_t alignBlob(uint64_t offset)
+        {
+            return (offset + HMESH_BLOB_ALIGNMENT - 1) & ~(HMESH_BLOB_ALIGNMENT - 1);
+        }
+    }
+
+    uint64_t HuhuMeshCache::configKeyFor(const ModelConfigInfo &configInfo)
+    {
+        return (uint64_t{configFlagsFor(configInfo)} << 32) | lodConfigHashFor(configInfo);
+    }
+
+    std::string HuhuMeshCache::cachePathFor(const std::string &sourcePath, const ModelConfigInfo &configInfo)
+    {
+        char configKey[17];
+        snprintf(configKey, sizeof(configKey), "%016llx", static_cast<unsigned long long>(configKeyFor(configInfo)));
+        return sourcePath + "." + configKey + ".hmesh";
+    }
+
+    std::unique_ptr<HuhuMeshCache::CachedMesh> HuhuMeshCache::open(const std::string &cachePath, const std::string &sourcePath, const ModelConfigInfo &configInfo)
+    {
+        SourceStamp stamp{};
+        std::error_code ec;
+        if (!std::filesystem::exists(cachePath, ec) || !stampSource(sourcePath, stamp))
+            return nullptr;
+
+        // a cache we can't map (empty file from a crash, permissions) is just a miss
+        std::unique_ptr<HuhuMappedFile> file;
+        try
+        {
+            file = std::make_unique<HuhuMappedFile>(cachePath);
+        }
+        catch (const std::runtime_error &)
+        {
+            return nullptr;
+        }
+        if (file->size() < sizeof(HmeshHeader))
+            return nullptr;
+
+        HmeshHeader header{};
+        memcpy(&header, file->data(), sizeof(header));
+
+        if (memcmp(header.magic, HMESH_MAGIC, sizeof(HMESH_MAGIC)) != 0 ||
+            header.version != VERSION ||
+            header.vertexStride != HuhuModel::getVertexStride(configInfo.vertexFormat) ||
+            header.configFlags != configFlagsFor(configInfo) ||
+            header.lodConfigHash != lodConfigHashFor(configInfo) ||
+            header.sourceSize != stamp.size ||
+            header.sourceModifiedTime != stamp.modifiedTime)
+        {
+            return nullptr; // stale or foreign, the caller rebuilds it from the source
+        }
+
+        const uint64_t vertexBytes = uint64_t{header.vertexCount} * header.vertexStride;
+        const uint64_t indexBytes = uint64_t{header.indexCount} * sizeof(uint32_t);
+        const uint64_t submeshBytes = uint64_t{header.submeshCount} * sizeof(HuhuModel::Submesh);
+        const uint64_t lodBytes = uint64_t{header.lodCount} * sizeof(HuhuModel::Lod);
+        const uint64_t meshletBytes = uint64_t{header.meshletCount} * sizeof(HuhuModel::Meshlet);
+        if (header.vertexOffset + vertexBytes > file->size() || header.indexOffset + indexBytes > file->size() ||
+            header.submeshOffset + submeshBytes > file->size() || header.lodOffset + lodBytes > file->size() ||
+            header.meshletOffset + meshletBytes > file->size())
+            return nullptr; // truncated write
+
+        HuhuModel::MeshData meshData{};
+        meshData.vertexFormat = configInfo.vertexFormat;
+        meshData.vertices = file->data() + header.vertexOffset;
+        meshData.vertexCount = header.vertexCount;
+        meshData.indices = reinterpret_cast<const uint32_t *>(file->data() + header.indexOffset);
+        meshData.indexCount = header.indexCount;
+        meshData.submeshes = reinterpret_cast<const HuhuModel::Submesh *>(file->data() + header.submeshOffset);
+        meshData.submeshCount = header.submeshCount;
+        meshData.lods = reinterpret_cast<const HuhuModel::Lod *>(file->data() + header.lodOffset);
+        meshData.lodCount = header.lodCount;
+        meshData.meshlets = reinterpret_cast<const HuhuModel::Meshlet *>(file->data() + header.meshletOffset);
+        meshData.meshletCount = header.meshletCount;
+        meshData.bounds.min = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+        meshData.bounds.max = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+
+        return std::make_unique<CachedMesh>(std::move(file), meshData);
+    }
+
+    bool HuhuMeshCache::write(const std::string &cachePath, const std::string &sourcePath, const ModelConfigInfo &configInfo, const HuhuModel::MeshData &meshData)
+    {
+        SourceStamp stamp{};
+        if (!stampSource(sourcePath, stamp))
+            return false;
+
+        HmeshHeader header{};
+        memcpy(header.magic, HMESH_MAGIC, sizeof(HMESH_MAGIC));
+        header.version = VERSION;
+        header.sourceSize = stamp.size;
+        header.sourceModifiedTime = stamp.modifiedTime;
+        header.vertexStride = HuhuModel::getVertexStride(meshData.vertexFormat);
+        header.configFlags = configFlagsFor(configInfo);
+        header.vertexCount = meshData.vertexCount;
+        header.indexCount = meshData.indexCount;
+        header.submeshCount = meshData.submeshCount;
+        header.lodCount = meshData.lodCount;
+        header.lodConfigHash = lodConfigHashFor(configInfo);
+        header.meshletCount = meshData.meshletCount;
+        for (int i = 0; i < 3; i++)
+        {
+            header.boundsMin[i] = meshData.bounds.min[i];
+            header.boundsMax[i] = meshData.bounds.max[i];
+        }
+
+        const uint64_t vertexBytes = uint64_t{header.vertexCount} * header.vertexStride;
+        const uint64_t indexBytes = uint64_t{header.indexCount} * sizeof(uint32_t);
+        header.vertexOffset = alignBlob(sizeof(HmeshHeader));
+        header.indexOffset = alignBlob(header.vertexOffset + vertexBytes);
+        const uint64_t submeshBytes = uint64_t{header.submeshCount} * sizeof(HuhuModel::Submesh);
+        header.submeshOffset = alignBlob(header.indexOffset + indexBytes);
+        const uint64_t lodBytes = uint64_t{header.lodCount} * sizeof(HuhuModel::Lod);
+        header.lodOffset = alignBlob(header.submeshOffset + submeshBytes);
+        const uint64_t meshletBytes = uint64_t{header.meshletCount} * sizeof(HuhuModel::Meshlet);
+        header.meshletOffset = alignBlob(header.lodOffset + lodBytes);
+
+        // Write to a temporary first so a crash mid-write never leaves a cache that looks valid. The name is unique per
+        // process and write, concurrent writers of the same cache each rename a complete file and the last one wins.
+        static std::atomic<uint64_t> writeCounter{0};
+        const std::string tempPath = cachePath + "." + std::to_string(getpid()) + "." + std::to_string(writeCounter++) + ".tmp";
+        {
+            std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+            if (!file.is_open())
+            {
+                std::cerr << "failed to write mesh cache: " << cachePath << std::endl;
+                return false;
+            }
+
+            const char padding[HMESH_BLOB_ALIGNMENT] = {};
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(padding, header.vertexOffset - sizeof(header));
+            file.write(reinterpret_cast<const char *>(meshData.vertices), vertexBytes);
+            file.write(padding, header.indexOffset - (header.vertexOffset + vertexBytes));
+            file.write(reinterpret_cast<const char *>(meshData.indices), indexBytes);
+            file.write(padding, header.submeshOffset - (header.indexOffset + indexBytes));
+            file.write(reinterpret_cast<const char *>(meshData.submeshes), submeshBytes);
+            file.write(padding, header.lodOffset - (header.submeshOffset + submeshBytes));
+            file.write(reinterpret_cast<const char *>(meshData.lods), lodBytes);
+            file.write(padding, header.meshletOffset - (header.lodOffset + lodBytes));
+            file.write(reinterpret_cast<const char *>(meshData.meshlets), meshletBytes);
+
+            if (!file.good())
+            {
+                file.close();
+                std::remove(tempPath.c_str());
+                std::cerr << "failed to write mesh cache: " << cachePath << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, cachePath, ec);
+        if (ec)
+        {
+            std::remove(tempPath.c_str());
+            std::cerr << "failed to write mesh cache: " << cachePath << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
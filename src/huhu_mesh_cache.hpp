@@ -0,0 +1,44 @@
+#pragma once
+
+#include "huhu_model.hpp"
+#include "huhu_mapped_file.hpp"
+
+// std
+#include <memory>
+#include <string>
+
+namespace huhu
+{
+    // Binary .hmesh cache written next to the source asset. Layout is a fixed header followed by the vertex blob
+    // (Vertex or PackedVertex layout), the index blob and the submesh, LOD and meshlet tables, so a cache hit can go straight
+    // into the staging buffer.
+    class HuhuMeshCache
+    {
+    public:
+        static constexpr uint32_t VERSION = 4;
+
+        // keeps the .hmesh mapped for as long as the mesh data view is in use
+        class CachedMesh
+        {
+        public:
+            CachedMesh(std::unique_ptr<HuhuMappedFile> file, const HuhuModel::MeshData &meshData)
+                : file{std::move(file)}, meshData{meshData} {}
+
+            const HuhuModel::MeshData &getMeshData() const { return meshData; }
+
+        private:
+            std::unique_ptr<HuhuMappedFile> file;
+            HuhuModel::MeshData meshData;
+        };
+
+        // one file per source and config, so loading the same source with different configs doesn't fight over it
+        static std::string cachePathFor(const std::string &sourcePath, const ModelConfigInfo &configInfo);
+        // same value for exactly the configs that produce the same baked mesh
+        static uint64_t configKeyFor(const ModelConfigInfo &configInfo);
+
+        // returns nullptr if there is no cache or it is stale (source size or mtime changed, format or config changed)
+        static std::unique_ptr<CachedMesh> open(const std::string &cachePath, const std::string &sourcePath, const ModelConfigInfo &configInfo);
+        // returns false if the cache could not be written, loading still works without it
+        static bool write(const std::string &cachePath, const std::string &sourcePath, const ModelConfigInfo &configInfo, const HuhuModel::MeshData &meshData);
+    };
+}
@@ -0,0 +1,794 @@
+#include "huhu_mesh_optimizer.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace huhu
+{
+    namespace
+    {
+        constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+        // scoring tables from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+        constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+        constexpr uint32_t FORSYTH_MAX_VALENCE = 32;
+
+        struct ForsythScores
+        {
+            float cache[FORSYTH_CACHE_SIZE];
+            float valence[FORSYTH_MAX_VALENCE + 1];
+
+            ForsythScores()
+            {
+                for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++)
+                {
+                    // the last triangle's vertices get a fixed score, otherwise we'd prefer to draw the same one again
+                    cache[i] = i < 3 ? 0.75f : std::pow(1.f - (i - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), 1.5f);
+                }
+
+                valence[0] = 0.f;
+                for (uint32_t i = 1; i <= FORSYTH_MAX_VALENCE; i++)
+                {
+                    // vertices with few triangles left get a boost so we finish them off and don't leave lone triangles
+                    valence[i] = 2.f / std::sqrt(static_cast<float>(i));
+                }
+            }
+
+            float vertexScore(int32_t cachePosition, uint32_t liveTriangles) const
+            {
+                if (liveTriangles == 0)
+                    return -1.f; // nothing left to draw with this vertex
+
+                const float cacheScore = cachePosition >= 0 ? cache[cachePosition] : 0.f;
+                return cacheScore + valence[std::min(liveTriangles, FORSYTH_MAX_VALENCE)];
+            }
+        };
+
+        // FIFO cache simulation shared by the analyzer and the overdraw pass. Bumping the clock by more than the
+        // cache size is a cheap way to flush it.
+        struct FifoCache
+        {
+            FifoCache(uint32_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), cacheSize{cacheSize}, time{cacheSize + 1} {}
+
+            uint32_t triangleMisses(const uint32_t *triangle)
+            {
+                uint32_t misses = 0;
+                for (int i = 0; i < 3; i++)
+                {
+                    if (time - timestamps[triangle[i]] > cacheSize)
+                    {
+                        timestamps[triangle[i]] = time++;
+                        misses++;
+                    }
+                }
+                return misses;
+            }
+
+            void flush() { time += cacheSize + 1; }
+
+            std::vector<uint32_t> timestamps;
+            uint32_t cacheSize;
+            uint32_t time;
+        };
+
+        // symmetric 4x4 error quadric, stored as the upper triangle of A, b and c so error(p) = p'Ap + 2b'p + c
+        struct Quadric
+        {
+            double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+            double b0 = 0, b1 = 0, b2 = 0;
+            double c = 0;
+            double weight = 0;
+
+            static Quadric fromPlane(const glm::vec3 &normal, float distance, double weight)
+            {
+                const double nx = normal.x, ny = normal.y, nz = normal.z, d = distance;
+
+                Quadric quadric{};
+                quadric.a00 = weight * nx * nx;
+                quadric.a11 = weight * ny * ny;
+                quadric.a22 = weight * nz * nz;
+                quadric.a01 = weight * nx * ny;
+                quadric.a02 = weight * nx * nz;
+                quadric.a12 = weight * ny * nz;
+                quadric.b0 = weight * nx * d;
+                quadric.b1 = weight * ny * d;
+                quadric.b2 = weight * nz * d;
+                quadric.c = weight * d * d;
+                quadric.weight = weight;
+                return quadric;
+            }
+
+            Quadric &operator+=(const Quadric &other)
+            {
+                a00 += other.a00, a11 += other.a11, a22 += other.a22;
+                a01 += other.a01, a02 += other.a02, a12 += other.a12;
+                b0 += other.b0, b1 += other.b1, b2 += other.b2;
+                c += other.c;
+                weight += other.weight;
+                return *this;
+            }
+
+            // weighted mean squared distance to all the planes
+            double error(const glm::vec3 &point) const
+            {
+                const double x = point.x, y = point.y, z = point.z;
+                const double sum = a00 * x * x + a11 * y * y + a22 * z * z +
+                                   2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                                   2 * (b0 * x + b1 * y + b2 * z) + c;
+                return weight > 0 ? std::max(sum, 0.0) / weight : 0.0;
+            }
+        };
+
+        enum class CollapseKind : uint8_t
+        {
+            Manifold, // can go anywhere
+            Border,   // open edge, may only slide along it
+            Locked    // non-manifold or a bow tie, stays put
+        };
+
+        uint64_t edgeKey(uint32_t from, uint32_t to) { return (uint64_t{from} << 32) | to; }
+
+        // closest point on a triangle, from Ericson's "Real-Time Collision Detection" 5.1.5
+        float distanceToTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+        {
+            const glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+            const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+            if (d1 <= 0.f && d2 <= 0.f)
+                return glm::length(p - a);
+
+            const glm::vec3 bp = p - b;
+            const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+            if (d3 >= 0.f && d4 <= d3)
+                return glm::length(p - b);
+
+            const float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+                return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+
+            const glm::vec3 cp = p - c;
+            const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+            if (d6 >= 0.f && d5 <= d6)
+                return glm::length(p - c);
+
+            const float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+                return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+
+            const float va = d3 * d6 - d5 * d4;
+            if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+                return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+
+            const float denominator = 1.f / (va + vb + vc);
+            return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+        }
+    }
+
+    HuhuModel::VertexCacheStats HuhuMeshOptimizer::analyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize)
+    {
+        HuhuModel::VertexCacheStats stats{};
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return stats;
+
+        FifoCache cache{vertexCount, cacheSize};
+        size_t misses = 0;
+        for (size_t triangle = 0; triangle < triangleCount; triangle++)
+        {
+            misses += cache.triangleMisses(&indices[triangle * 3]);
+        }
+
+        // every vertex that got drawn has a timestamp by now
+        const size_t usedVertices = vertexCount - std::count(cache.timestamps.begin(), cache.timestamps.end(), 0u);
+
+        stats.acmr = static_cast<float>(misses) / triangleCount;
+        stats.atvr = usedVertices ? static_cast<float>(misses) / usedVertices : 0.f;
+        return stats;
+    }
+
+    void HuhuMeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        static const ForsythScores scores{};
+
+        // triangles using each vertex, the first liveTriangles[v] entries of a vertex's range are the ones not drawn yet
+        std::vector<uint32_t> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+        {
+            liveTriangles[indices[i]]++;
+        }
+
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+        {
+            adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+        }
+
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        {
+            std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < triangleCount * 3; i++)
+            {
+                adjacency[fillOffsets[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+        {
+            vertexScores[vertex] = scores.vertexScore(-1, liveTriangles[vertex]);
+        }
+
+        std::vector<float> triangleScores(triangleCount);
+        uint32_t bestTriangle = 0;
+        for (size_t triangle = 0; triangle < triangleCount; triangle++)
+        {
+            const uint32_t *corners = &indices[triangle * 3];
+            triangleScores[triangle] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+            if (triangleScores[triangle] > triangleScores[bestTriangle])
+                bestTriangle = static_cast<uint32_t>(triangle);
+        }
+
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> cache{}, newCache{};
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+        newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+        std::vector<uint32_t> result{};
+        result.reserve(triangleCount * 3);
+
+        size_t cursor = 0; // first triangle that might not be emitted yet, used when the cache has nothing to offer
+        bool haveBest = true;
+        while (result.size() < triangleCount * 3)
+        {
+            if (!haveBest)
+            {
+                while (emitted[cursor])
+                    cursor++;
+                bestTriangle = static_cast<uint32_t>(cursor);
+            }
+
+            emitted[bestTriangle] = 1;
+            const uint32_t *corners = &indices[bestTriangle * 3];
+            result.insert(result.end(), corners, corners + 3);
+
+            // retire the triangle from its vertices, and put the vertices at the front of the cache
+            newCache.clear();
+            for (int i = 0; i < 3; i++)
+            {
+                const uint32_t vertex = corners[i];
+                uint32_t *live = &adjacency[adjacencyOffsets[vertex]];
+                uint32_t *last = live + --liveTriangles[vertex];
+                *std::find(live, last + 1, bestTriangle) = *last;
+
+                if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end())
+                    newCache.push_back(vertex);
+            }
+            for (uint32_t vertex : cache)
+            {
+                if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+                    newCache.push_back(vertex);
+            }
+
+            // rescore everything that moved in the cache (including what just fell out) and push the change onto
+            // the triangles that still use it
+            for (size_t position = 0; position < newCache.size(); position++)
+            {
+                const uint32_t vertex = newCache[position];
+                cachePositions[vertex] = position < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(position) : -1;
+
+                const float score = scores.vertexScore(cachePositions[vertex], liveTriangles[vertex]);
+                const float delta = score - vertexScores[vertex];
+                vertexScores[vertex] = score;
+
+                const uint32_t *live = &adjacency[adjacencyOffsets[vertex]];
+                for (uint32_t i = 0; i < liveTriangles[vertex]; i++)
+                {
+                    triangleScores[live[i]] += delta;
+                }
+            }
+
+            // next triangle is the best one touching the cache, checked after all deltas are in
+            haveBest = false;
+            float bestScore = std::numeric_limits<float>::lowest();
+            for (size_t position = 0; position < newCache.size() && position < FORSYTH_CACHE_SIZE; position++)
+            {
+                const uint32_t vertex = newCache[position];
+                const uint32_t *live = &adjacency[adjacencyOffsets[vertex]];
+                for (uint32_t i = 0; i < liveTriangles[vertex]; i++)
+                {
+                    if (triangleScores[live[i]] > bestScore)
+                    {
+                        bestScore = triangleScores[live[i]];
+                        bestTriangle = live[i];
+                        haveBest = true;
+                    }
+                }
+            }
+
+            if (newCache.size() > FORSYTH_CACHE_SIZE)
+                newCache.resize(FORSYTH_CACHE_SIZE);
+            std::swap(cache, newCache);
+        }
+
+        indices = std::move(result);
+    }
+
+    void HuhuMeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<HuhuModel::Vertex> &vertices, float threshold)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+        // hard boundaries are where the cache optimiser had to start over, i.e. a triangle that missed all three
+        std::vector<uint32_t> hardBoundaries{};
+        {
+            FifoCache cache{vertexCount, FIFO_CACHE_SIZE};
+            for (size_t triangle = 0; triangle < triangleCount; triangle++)
+            {
+                if (cache.triangleMisses(&indices[triangle * 3]) == 3 || triangle == 0)
+                    hardBoundaries.push_back(static_cast<uint32_t>(triangle));
+            }
+        }
+        hardBoundaries.push_back(static_cast<uint32_t>(triangleCount));
+
+        // split those further wherever a cluster on its own (cold cache) is already about as good as the whole run
+        std::vector<uint32_t> clusters{};
+        {
+            FifoCache cache{vertexCount, FIFO_CACHE_SIZE};
+            for (size_t hard = 0; hard + 1 < hardBoundaries.size(); hard++)
+            {
+                const uint32_t start = hardBoundaries[hard];
+                const uint32_t end = hardBoundaries[hard + 1];
+
+                cache.flush();
+                uint32_t hardMisses = 0;
+                for (uint32_t triangle = start; triangle < end; triangle++)
+                {
+                    hardMisses += cache.triangleMisses(&indices[triangle * 3]);
+                }
+                const float clusterThreshold = threshold * hardMisses / (end - start);
+
+                cache.flush();
+                clusters.push_back(start);
+                uint32_t clusterStart = start;
+                uint32_t clusterMisses = 0;
+                for (uint32_t triangle = start; triangle < end; triangle++)
+                {
+                    clusterMisses += cache.triangleMisses(&indices[triangle * 3]);
+                    if (triangle + 1 < end && clusterMisses <= clusterThreshold * (triangle + 1 - clusterStart))
+                    {
+                        clusters.push_back(triangle + 1);
+                        clusterStart = triangle + 1;
+                        clusterMisses = 0;
+                        cache.flush();
+                    }
+                }
+            }
+        }
+        clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+        glm::vec3 meshCentroid{0.f};
+        for (const auto &vertex : vertices)
+        {
+            meshCentroid += vertex.position;
+        }
+        meshCentroid /= static_cast<float>(std::max<size_t>(vertices.size(), 1));
+
+        // clusters far out along their own normal are likely to cover the rest of the mesh, so they go first
+        struct ClusterKey
+        {
+            float key;
+            uint32_t cluster;
+        };
+        std::vector<ClusterKey> keys(clusters.size() - 1);
+        for (size_t cluster = 0; cluster + 1 < clusters.size(); cluster++)
+        {
+            glm::vec3 centroid{0.f};
+            glm::vec3 normal{0.f};
+            float area = 0.f;
+            for (uint32_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++)
+            {
+                const glm::vec3 &p0 = vertices[indices[triangle * 3 + 0]].position;
+                const glm::vec3 &p1 = vertices[indices[triangle * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[triangle * 3 + 2]].position;
+
+                const glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+                const float faceArea = glm::length(faceNormal);
+                centroid += (p0 + p1 + p2) * (faceArea / 3.f);
+                normal += faceNormal;
+                area += faceArea;
+            }
+
+            if (area > 0.f)
+                centroid /= area;
+            const float normalLength = glm::length(normal);
+            if (normalLength > 0.f)
+                normal /= normalLength;
+
+            keys[cluster] = {glm::dot(centroid - meshCentroid, normal), static_cast<uint32_t>(cluster)};
+        }
+
+        std::stable_sort(keys.begin(), keys.end(), [](const ClusterKey &a, const ClusterKey &b)
+                         { return a.key > b.key; });
+
+        std::vector<uint32_t> result{};
+        result.reserve(indices.size());
+        for (const auto &key : keys)
+        {
+            result.insert(result.end(), indices.begin() + clusters[key.cluster] * 3, indices.begin() + clusters[key.cluster + 1] * 3);
+        }
+        indices = std::move(result);
+    }
+
+    std::vector<uint32_t> HuhuMeshOptimizer::simplify(const std::vector<uint32_t> &indices, const HuhuModel::Vertex *vertices, uint32_t vertexCount,
+                                                       float targetError, float &resultError)
+    {
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        constexpr double BORDER_WEIGHT = 10.0;
+        resultError = 0.f;
+
+        // collapse on positions, vertices that only differ in attributes ("wedges") move together
+        std::vector<uint32_t> positionOf(vertexCount);
+        {
+            std::vector<uint32_t> order(vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++)
+                order[i] = i;
+
+            auto less = [vertices](uint32_t a, uint32_t b)
+            {
+                const glm::vec3 &pa = vertices[a].position, &pb = vertices[b].position;
+                if (pa.x != pb.x)
+                    return pa.x < pb.x;
+                if (pa.y != pb.y)
+                    return pa.y < pb.y;
+                return pa.z < pb.z;
+            };
+            std::sort(order.begin(), order.end(), less);
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                const bool samePosition = i > 0 && !less(order[i - 1], order[i]) && !less(order[i], order[i - 1]);
+                positionOf[order[i]] = samePosition ? positionOf[order[i - 1]] : order[i];
+            }
+        }
+
+        std::vector<uint32_t> wedgeOffsets(vertexCount + 1, 0);
+        std::vector<uint32_t> wedges(vertexCount);
+        {
+            for (uint32_t i = 0; i < vertexCount; i++)
+                wedgeOffsets[positionOf[i] + 1]++;
+            for (uint32_t i = 0; i < vertexCount; i++)
+                wedgeOffsets[i + 1] += wedgeOffsets[i];
+
+            std::vector<uint32_t> fill(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+            for (uint32_t i = 0; i < vertexCount; i++)
+                wedges[fill[positionOf[i]]++] = i;
+        }
+
+        // triangles in vertex indices, already degenerate ones (on positions) are dropped right away
+        std::vector<uint32_t> triangles{};
+        triangles.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const uint32_t p0 = positionOf[indices[i]], p1 = positionOf[indices[i + 1]], p2 = positionOf[indices[i + 2]];
+            if (p0 != p1 && p0 != p2 && p1 != p2)
+                triangles.insert(triangles.end(), &indices[i], &indices[i] + 3);
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            const glm::vec3 &p0 = vertices[triangles[i]].position;
+            const glm::vec3 &p1 = vertices[triangles[i + 1]].position;
+            const glm::vec3 &p2 = vertices[triangles[i + 2]].position;
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float doubleArea = glm::length(normal);
+            if (doubleArea == 0.f)
+                continue;
+            normal /= doubleArea;
+
+            const Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5);
+            for (int k = 0; k < 3; k++)
+                quadrics[positionOf[triangles[i + k]]] += plane;
+        }
+
+        std::vector<uint32_t> collapseTarget(vertexCount);
+        std::vector<uint8_t> touched(vertexCount);
+        std::vector<CollapseKind> kinds(vertexCount);
+        std::unordered_map<uint64_t, uint32_t> edgeCounts{};
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+        std::vector<uint32_t> adjacency{};
+
+        struct Collapse
+        {
+            uint32_t from;
+            uint32_t to;
+            double error;
+        };
+        std::vector<Collapse> collapses{};
+
+        const double errorLimit = double{targetError} * targetError;
+        bool borderQuadricsAdded = false;
+
+        // where each original position ended up, for measuring the error at the end
+        std::vector<uint32_t> finalPosition(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; i++)
+            finalPosition[i] = positionOf[i];
+
+        while (true)
+        {
+            // classify positions on the current topology
+            edgeCounts.clear();
+            edgeCounts.reserve(triangles.size());
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                    edgeCounts[edgeKey(positionOf[triangles[i + k]], positionOf[triangles[i + (k + 1) % 3]])]++;
+            }
+
+            std::fill(kinds.begin(), kinds.end(), CollapseKind::Manifold);
+            std::vector<uint8_t> borderOut(vertexCount, 0), borderIn(vertexCount, 0);
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    const uint32_t from = positionOf[triangles[i + k]], to = positionOf[triangles[i + (k + 1) % 3]];
+                    const uint32_t count = edgeCounts[edgeKey(from, to)];
+                    const auto opposite = edgeCounts.find(edgeKey(to, from));
+                    const uint32_t oppositeCount = opposite == edgeCounts.end() ? 0 : opposite->second;
+
+                    if (count > 1 || oppositeCount > 1)
+                    {
+                        kinds[from] = kinds[to] = CollapseKind::Locked;
+                    }
+                    else if (oppositeCount == 0)
+                    {
+                        borderOut[from]++;
+                        borderIn[to]++;
+
+                        if (!borderQuadricsAdded)
+                        {
+                            // keep borders from drifting inwards, a plane through the edge standing on the triangle
+                            const glm::vec3 &p0 = vertices[from].position, &p1 = vertices[to].position;
+                            const glm::vec3 &p2 = vertices[positionOf[triangles[i + (k + 2) % 3]]].position;
+                            const glm::vec3 edge = p1 - p0;
+                            glm::vec3 side = glm::cross(edge, glm::cross(edge, p2 - p0));
+                            const float sideLength = glm::length(side);
+                            if (sideLength > 0.f)
+                            {
+                                side /= sideLength;
+                                const Quadric border = Quadric::fromPlane(side, -glm::dot(side, p0), BORDER_WEIGHT * glm::dot(edge, edge));
+                                quadrics[from] += border;
+                                quadrics[to] += border;
+                            }
+                        }
+                    }
+                }
+            }
+            borderQuadricsAdded = true;
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                if (kinds[i] == CollapseKind::Locked || (borderOut[i] == 0 && borderIn[i] == 0))
+                    continue;
+                kinds[i] = borderOut[i] == 1 && borderIn[i] == 1 ? CollapseKind::Border : CollapseKind::Locked;
+            }
+
+            // candidate collapses, every edge once, in whichever direction is cheaper and allowed
+            collapses.clear();
+            auto canCollapse = [&](uint32_t from, uint32_t to)
+            {
+                if (kinds[from] == CollapseKind::Locked)
+                    return false;
+                if (kinds[from] == CollapseKind::Border)
+                    return kinds[to] != CollapseKind::Manifold && (edgeCounts.count(edgeKey(from, to)) + edgeCounts.count(edgeKey(to, from))) == 1;
+                return true;
+            };
+
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    const uint32_t a = positionOf[triangles[i + k]], b = positionOf[triangles[i + (k + 1) % 3]];
+                    if (a > b && edgeCounts.count(edgeKey(b, a)))
+                        continue; // interior edge, the other triangle has it the other way around
+
+                    Quadric combined = quadrics[a];
+                    combined += quadrics[b];
+                    const double errorAB = canCollapse(a, b) ? combined.error(vertices[b].position) : std::numeric_limits<double>::max();
+                    const double errorBA = canCollapse(b, a) ? combined.error(vertices[a].position) : std::numeric_limits<double>::max();
+
+                    if (errorAB <= errorBA && errorAB <= errorLimit)
+                        collapses.push_back({a, b, errorAB});
+                    else if (errorBA < errorAB && errorBA <= errorLimit)
+                        collapses.push_back({b, a, errorBA});
+                }
+            }
+            if (collapses.empty())
+                break;
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+                      { return x.error < y.error; });
+
+            // triangles around each position, for the flip test
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (size_t i = 0; i < triangles.size(); i++)
+                adjacencyOffsets[positionOf[triangles[i]] + 1]++;
+            for (uint32_t i = 0; i < vertexCount; i++)
+                adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+            adjacency.resize(triangles.size());
+            {
+                std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+                for (size_t i = 0; i < triangles.size(); i++)
+                    adjacency[fill[positionOf[triangles[i]]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+                collapseTarget[i] = i;
+            std::fill(touched.begin(), touched.end(), 0);
+
+            auto currentPosition = [&](uint32_t vertex) -> const glm::vec3 &
+            {
+                return vertices[collapseTarget[positionOf[vertex]]].position;
+            };
+
+            // Independent collapses only: each position takes part in at most one per pass, which keeps the
+            // quadrics and the flip test honest without a priority queue.
+            size_t collapseCount = 0;
+            for (const auto &collapse : collapses)
+            {
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+
+                bool flips = false;
+                const glm::vec3 &target = vertices[collapse.to].position;
+                for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++)
+                {
+                    const uint32_t *corners = &triangles[adjacency[j] * 3];
+                    glm::vec3 before[3], after[3];
+                    bool containsTarget = false;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        before[k] = currentPosition(corners[k]);
+                        after[k] = positionOf[corners[k]] == collapse.from ? target : before[k];
+                        containsTarget |= collapseTarget[positionOf[corners[k]]] == collapse.to;
+                    }
+                    if (containsTarget)
+                        continue; // this one disappears
+
+                    const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    flips = glm::dot(normalBefore, normalAfter) <= 0.f;
+                }
+                if (flips)
+                    continue;
+
+                touched[collapse.from] = touched[collapse.to] = 1;
+                collapseTarget[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                collapseCount++;
+            }
+            if (collapseCount == 0)
+                break;
+
+            for (uint32_t i = 0; i < vertexCount; i++)
+                finalPosition[i] = collapseTarget[finalPosition[i]];
+
+            // Move the wedges over. Each one picks the wedge at the new position with the closest attributes, that
+            // keeps hard normals and uv seams roughly where they were.
+            std::vector<uint32_t> wedgeTarget(vertexCount, NONE);
+            auto remapWedge = [&](uint32_t vertex)
+            {
+                const uint32_t position = positionOf[vertex];
+                const uint32_t targetPosition = collapseTarget[position];
+                if (targetPosition == position)
+                    return vertex;
+                if (wedgeTarget[vertex] != NONE)
+                    return wedgeTarget[vertex];
+
+                const HuhuModel::Vertex &source = vertices[vertex];
+                float bestDistance = std::numeric_limits<float>::max();
+                for (uint32_t j = wedgeOffsets[targetPosition]; j < wedgeOffsets[targetPosition + 1]; j++)
+                {
+                    const HuhuModel::Vertex &candidate = vertices[wedges[j]];
+                    const glm::vec3 normalDelta = candidate.normal - source.normal;
+                    const glm::vec3 colorDelta = candidate.color - source.color;
+                    const glm::vec2 uvDelta = candidate.uv - source.uv;
+                    const float distance = glm::dot(normalDelta, normalDelta) + glm::dot(colorDelta, colorDelta) + glm::dot(uvDelta, uvDelta);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        wedgeTarget[vertex] = wedges[j];
+                    }
+                }
+                return wedgeTarget[vertex];
+            };
+
+            size_t kept = 0;
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                const uint32_t v0 = remapWedge(triangles[i]), v1 = remapWedge(triangles[i + 1]), v2 = remapWedge(triangles[i + 2]);
+                const uint32_t p0 = positionOf[v0], p1 = positionOf[v1], p2 = positionOf[v2];
+                if (p0 == p1 || p0 == p2 || p1 == p2)
+                    continue;
+
+                triangles[kept++] = v0;
+                triangles[kept++] = v1;
+                triangles[kept++] = v2;
+            }
+            triangles.resize(kept);
+        }
+
+        // The quadric error is an average over planes and tends to undersell how far things moved. Measure instead:
+        // every original position against the triangles now around the position it was collapsed into.
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t i = 0; i < triangles.size(); i++)
+            adjacencyOffsets[positionOf[triangles[i]] + 1]++;
+        for (uint32_t i = 0; i < vertexCount; i++)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        adjacency.resize(triangles.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++)
+                adjacency[fill[positionOf[triangles[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            const uint32_t survivor = finalPosition[i];
+            if (positionOf[i] != i || survivor == i || adjacencyOffsets[survivor] == adjacencyOffsets[survivor + 1])
+                continue; // wedge duplicate, never moved, or its whole neighbourhood is gone
+
+            // the closest point is usually in the survivor's triangles, but can be one ring further out
+            float distance = std::numeric_limits<float>::max();
+            for (uint32_t j = adjacencyOffsets[survivor]; j < adjacencyOffsets[survivor + 1]; j++)
+            {
+                const uint32_t *ring = &triangles[adjacency[j] * 3];
+                for (int k = 0; k < 3; k++)
+                {
+                    const uint32_t neighbour = positionOf[ring[k]];
+                    for (uint32_t n = adjacencyOffsets[neighbour]; n < adjacencyOffsets[neighbour + 1]; n++)
+                    {
+                        const uint32_t *corners = &triangles[adjacency[n] * 3];
+                        distance = std::min(distance, distanceToTriangle(vertices[i].position, vertices[corners[0]].position,
+                                                                         vertices[corners[1]].position, vertices[corners[2]].position));
+                    }
+                }
+            }
+            resultError = std::max(resultError, distance);
+        }
+
+        return triangles;
+    }
+
+    void HuhuMeshOptimizer::optimizeVertexFetch(std::vector<HuhuModel::Vertex> &vertices, std::vector<uint32_t> &indices)
+    {
+        constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+
+        std::vector<uint32_t> remap(vertices.size(), UNUSED);
+        std::vector<HuhuModel::Vertex> reordered{};
+        reordered.reserve(vertices.size());
+
+        for (auto &index : indices)
+        {
+            if (remap[index] == UNUSED)
+            {
+                remap[index] = static_cast<uint32_t>(reordered.size());
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+
+        vertices = std::move(reordered);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "huhu_model.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace huhu
+{
+    // Offline reordering passes for indexed triangle lists. None of them change what gets drawn, only the order, so
+    // they are free at runtime and just make the vertex shader and vertex fetch do less work.
+    class HuhuMeshOptimizer
+    {
+    public:
+        // simulates a FIFO post-transform cache of cacheSize entries, which is roughly what current GPUs behave like
+        static HuhuModel::VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+        // Forsyth's linear-speed vertex cache optimisation, reorders triangles so shared vertices hit the cache
+        static void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+        // Splits a cache optimised index list into clusters and sorts those front to back from the outside in, so
+        // occluders tend to be drawn first. threshold is how much worse the ACMR is allowed to get (1.05 = 5%).
+        static void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<HuhuModel::Vertex> &vertices, float threshold = 1.05f);
+
+        // Quadric error edge collapse (Garland & Heckbert), returns a new index list into the same vertices. Collapses
+        // continue until the quadrics estimate the next one would move the surface by more than targetError (model
+        // units). resultError is measured afterwards and can come out above that, it's what LOD selection should use.
+        // Vertices sharing a position are collapsed together so attribute seams don't tear, open borders only slide
+        // along themselves and non-manifold vertices never move.
+        static std::vector<uint32_t> simplify(const std::vector<uint32_t> &indices, const HuhuModel::Vertex *vertices, uint32_t vertexCount,
+                                              float targetError, float &resultError);
+
+        // renumbers vertices in first use order so vertex fetch walks memory linearly, unused vertices are dropped
+        static void optimizeVertexFetch(std::vector<HuhuModel::Vertex> &vertices, std::vector<uint32_t> &indices);
+    };
+}
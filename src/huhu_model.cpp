@@ -1,135 +1,474 @@
 #include "huhu_model.hpp"
 
-#include "huhu_utils.hpp"
+#include "huhu_mesh_cache.hpp"
+#include "huhu_mesh_optimizer.hpp"
+#include "huhu_obj_loader.hpp"
+#include "huhu_upload_batch.hpp"
 
 // libs
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
-#include <unordered_map>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
 
-namespace std
+namespace huhu
 {
-    template <>
-    struct hash<huhu::HuhuModel::Vertex>
+    namespace
     {
-        size_t operator()(huhu::HuhuModel::Vertex const &vertex) const
+        static_assert(sizeof(HuhuModel::Vertex) == 11 * sizeof(float), "vertex hashing assumes no padding");
+
+        // Hashes the raw bits of a vertex. -0.0 gets folded into +0.0 first since operator== treats them as equal.
+        uint64_t hashVertexBits(const HuhuModel::Vertex &vertex)
         {
-            size_t seed = 0;
-            huhu::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
-            return seed;
+            constexpr size_t WORD_COUNT = sizeof(HuhuModel::Vertex) / sizeof(uint32_t);
+            uint32_t words[WORD_COUNT];
+            memcpy(words, &vertex, sizeof(words));
+
+            uint64_t hash = 0x9e3779b97f4a7c15ull;
+            for (size_t i = 0; i < WORD_COUNT; i++)
+            {
+                const uint32_t word = words[i] == 0x80000000u ? 0u : words[i];
+                hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+                hash ^= hash >> 32;
+            }
+            hash ^= hash >> 29;
+            hash *= 0xc4ceb9fe1a85ec53ull;
+            hash ^= hash >> 32;
+            return hash;
         }
-    };
-}
 
-namespace huhu
-{
-    HuhuModel::HuhuModel(HuhuDevice &device, const HuhuModel::Builder &builder) : huhuDevice{device}
+        // Flat open addressing table used to weld identical vertices. Slots only hold a hash tag and an index into the
+        // vertex array, so lookups touch one small contiguous array and nothing gets allocated per vertex. It's sized
+        // for the worst case up front (every corner unique) so it never needs to grow.
+        class VertexWeldTable
+        {
+        public:
+            VertexWeldTable(size_t maxVertexCount)
+            {
+                size_t capacity = 16;
+                while (capacity < maxVertexCount + maxVertexCount / 2) // keeps the load factor under 2/3
+                    capacity <<= 1;
+                slots.resize(capacity);
+                mask = capacity - 1;
+            }
+
+            // Returns the index of the vertex equal to this one, appending it to vertices first if it's new.
+            uint32_t findOrInsert(const HuhuModel::Vertex &vertex, std::vector<HuhuModel::Vertex> &vertices)
+            {
+                const uint64_t hash = hashVertexBits(vertex);
+                const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+                for (size_t slot = static_cast<size_t>(hash) & mask;; slot = (slot + 1) & mask)
+                {
+                    Slot &entry = slots[slot];
+                    if (entry.index == EMPTY)
+                    {
+                        assert(vertices.size() < slots.size() && "weld table sized too small");
+                        entry.tag = tag;
+                        entry.index = static_cast<uint32_t>(vertices.size());
+                        vertices.push_back(vertex);
+                        return entry.index;
+                    }
+                    if (entry.tag == tag && vertices[entry.index] == vertex)
+                        return entry.index;
+                }
+            }
+
+        private:
+            static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+            struct Slot
+            {
+                uint32_t tag = 0;
+                uint32_t index = EMPTY;
+            };
+
+            std::vector<Slot> slots;
+            size_t mask;
+        };
+
+        // the blocking path, streams everything through the staging ring as one upload batch and waits for it
+        void uploadImmediately(HuhuDevice &device, HuhuModel::StagedUpload &upload)
+        {
+            HuhuStagingRing &ring = device.stagingRing();
+            HuhuUploadBatch batch{device};
+            std::vector<HuhuModel::StagedUpload::Copy> copies{};
+            while (true)
+            {
+                copies.clear();
+                const bool staged = upload.stage(ring, copies);
+                for (const auto &copy : copies)
+                {
+                    batch.copyBuffer(ring.getBuffer(), copy.dstBuffer, copy.size, copy.srcOffset, copy.dstOffset);
+                }
+                if (staged)
+                    break;
+
+                // the ring is full, get our part of it going and wait for room
+                batch.flush();
+                ring.waitOldest();
+            }
+            batch.submit();
+            batch.wait();
+        }
+    }
+
+    bool HuhuModel::StagedUpload::stage(HuhuStagingRing &ring, std::vector<Copy> &copies)
+    {
+        for (auto &write : writes)
+        {
+            while (write.stagedSize < write.size)
+            {
+                const VkDeviceSize chunkSize = std::min(write.size - write.stagedSize, ring.getMaxChunkSize());
+                StagingRegion region{};
+                if (!ring.allocate(chunkSize, 16, region))
+                    return false;
+
+                if (write.narrowIndices)
+                {
+                    // narrow straight into the mapped ring, no extra copy
+                    const uint32_t *indices = static_cast<const uint32_t *>(write.data) + write.stagedSize / sizeof(uint16_t);
+                    auto *narrowIndices = static_cast<uint16_t *>(region.mapped);
+                    for (VkDeviceSize i = 0; i < chunkSize / sizeof(uint16_t); i++)
+                    {
+                        narrowIndices[i] = static_cast<uint16_t>(indices[i]);
+                    }
+                }
+                else
+                {
+                    memcpy(region.mapped, static_cast<const char *>(write.data) + write.stagedSize, chunkSize);
+                }
+
+                copies.push_back({region.offset, write.dstBuffer, write.dstOffset + write.stagedSize, chunkSize, write.sharedDestination,
+                                  write.stagedSize + chunkSize == write.size});
+                write.stagedSize += chunkSize;
+            }
+        }
+        return true;
+    }
+
+    HuhuModel::HuhuModel(HuhuDevice &device, const HuhuModel::Builder &builder) : HuhuModel{device, builder.getMeshData()} {}
+
+    HuhuModel::HuhuModel(HuhuDevice &device, const HuhuModel::MeshData &meshData) : huhuDevice{device}
+    {
+        StagedUpload upload{};
+        createBuffers(meshData, upload);
+        uploadImmediately(huhuDevice, upload);
+    }
+
+    HuhuModel::HuhuModel(HuhuDevice &device, const HuhuModel::MeshData &meshData, StagedUpload &upload, HuhuGeometryArena *geometryArena)
+        : huhuDevice{device}, geometryArena{geometryArena}
     {
-        createVertexBuffers(builder.vertices);
-        createIndexBuffers(builder.indices);
+        createBuffers(meshData, upload);
     }
 
-    HuhuModel::~HuhuModel() {}
+    HuhuModel::~HuhuModel()
+    {
+        // frames in flight may still draw from the ranges, they can't be handed out again before those are done
+        if (vertexRange.count > 0 || indexRange.count > 0)
+        {
+            huhuDevice.deletionQueue().defer(
+                [geometryArena = geometryArena, vertexRange = vertexRange, indexRange = indexRange]()
+                {
+                    if (vertexRange.count > 0)
+                        geometryArena->free(vertexRange);
+                    if (indexRange.count > 0)
+                        geometryArena->free(indexRange);
+                });
+        }
+    }
+
+    void HuhuModel::createBuffers(const MeshData &meshData, StagedUpload &upload)
+    {
+        bounds = meshData.bounds;
+        vertexFormat = meshData.vertexFormat;
+        if (vertexFormat == VertexFormat::Packed)
+        {
+            // unorm [0, 1] -> [min, max], same mapping PackedVertex::pack quantized with
+            positionDecodeMatrix = glm::translate(glm::mat4{1.f}, bounds.min);
+            positionDecodeMatrix = glm::scale(positionDecodeMatrix, bounds.max - bounds.min);
+        }
+
+        createVertexBuffers(meshData.vertices, getVertexStride(vertexFormat), meshData.vertexCount, upload);
+        createIndexBuffers(meshData.indices, meshData.indexCount, upload);
+        createSubmeshes(meshData.submeshes, meshData.submeshCount, meshData.lods, meshData.lodCount);
+        meshlets.assign(meshData.meshlets, meshData.meshlets + meshData.meshletCount);
+    }
+
+    std::unique_ptr<HuhuModel> HuhuModel::createModelFromFile(HuhuDevice &device, const std::string &filepath, const ModelConfigInfo &configInfo)
+    {
+        StagedUpload upload{};
+        auto model = createModelFromFile(device, filepath, configInfo, upload);
+        uploadImmediately(device, upload);
+        return model;
+    }
 
-    std::unique_ptr<HuhuModel> HuhuModel::createModelFromFile(HuhuDevice &device, const std::string &filepath)
+    std::unique_ptr<HuhuModel> HuhuModel::createModelFromFile(HuhuDevice &device, const std::string &filepath, const ModelConfigInfo &configInfo, StagedUpload &upload)
     {
-        Builder builder{};
+        // a valid cache skips parsing and vertex dedup entirely, the mapped blobs get copied straight into staging
+        const std::string cachePath = HuhuMeshCache::cachePathFor(filepath, configInfo);
+        if (std::shared_ptr<const HuhuMeshCache::CachedMesh> cachedMesh = HuhuMeshCache::open(cachePath, filepath, configInfo))
+        {
+            auto model = std::make_unique<HuhuModel>(device, cachedMesh->getMeshData(), upload, configInfo.geometryArena);
+            upload.source = std::move(cachedMesh); // the writes point into the mapping
+            return model;
+        }
+
+        auto builderPtr = std::make_shared<Builder>();
+        Builder &builder = *builderPtr;
         builder.loadModel(filepath);
-        return std::make_unique<HuhuModel>(device, builder);
+        if (configInfo.optimizeMesh)
+        {
+            auto [before, after] = builder.optimize();
+            std::cout << "optimized " << filepath << ": ACMR " << before.acmr << " -> " << after.acmr
+                      << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+        }
+        if (configInfo.splitSubmeshes)
+        {
+            builder.splitSubmeshes();
+        }
+        if (configInfo.buildMeshlets)
+        {
+            builder.buildMeshlets();
+        }
+        if (!configInfo.lodTargetErrors.empty())
+        {
+            builder.generateLods(configInfo.lodTargetErrors);
+        }
+        if (configInfo.vertexFormat == VertexFormat::Packed)
+        {
+            builder.packVertices();
+        }
+        HuhuMeshCache::write(cachePath, filepath, configInfo, builder.getMeshData());
+        auto model = std::make_unique<HuhuModel>(device, builder.getMeshData(), upload, configInfo.geometryArena);
+        upload.source = std::move(builderPtr);
+        return model;
     }
 
-    void HuhuModel::createVertexBuffers(const std::vector<Vertex> &vertices)
+    uint32_t HuhuModel::getVertexStride(VertexFormat vertexFormat)
     {
-        vertexCount = static_cast<uint32_t>(vertices.size());
-        assert(vertexCount >= 3 && "vertex count must be at least 3");
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-        uint32_t vertexSize = sizeof(vertices[0]);
-
-        // create staging buffer to stage to from host mem, and copy from into gpu mem
-        HuhuBuffer stagingBuffer{
-            huhuDevice,
-            vertexSize,
-            vertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            };
+        return vertexFormat == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
 
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void *)vertices.data());
+    VkDeviceSize HuhuModel::getMemorySize() const
+    {
+        VkDeviceSize size = vertexBuffer ? vertexBuffer->getBufferSize() : geometryArena->getByteSize(vertexRange);
+        if (hasIndexBuffer)
+            size += indexBuffer ? indexBuffer->getBufferSize() : geometryArena->getByteSize(indexRange);
+        return size;
+    }
 
-        // create destination vertex buffer in gpu mem and transfer the data to it
-        vertexBuffer = std::make_unique<HuhuBuffer>(
-            huhuDevice,
-            vertexSize,
-            vertexCount,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    void HuhuModel::createVertexBuffers(const void *vertices, uint32_t vertexSize, uint32_t vertexCount, StagedUpload &upload)
+    {
+        this->vertexCount = vertexCount;
+        assert(vertexCount >= 3 && "vertex count must be at least 3");
+        VkDeviceSize bufferSize = vertexSize * vertexCount;
 
-        huhuDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+        // the arena's shared vertex buffer if there's room, our own one otherwise
+        if (geometryArena && geometryArena->allocateVertices(vertexSize, vertexCount, vertexRange))
+        {
+            vertexBufferHandle = geometryArena->getBuffer(vertexRange);
+            upload.writes.push_back({vertices, bufferSize, vertexBufferHandle, geometryArena->getByteOffset(vertexRange), false, true});
+        }
+        else
+        {
+            vertexBuffer = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                vertexSize,
+                vertexCount,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            vertexBufferHandle = vertexBuffer->getBuffer();
+            upload.writes.push_back({vertices, bufferSize, vertexBufferHandle, 0, false, false});
+        }
     }
 
-    void HuhuModel::createIndexBuffers(const std::vector<uint32_t> &indices)
+    void HuhuModel::createIndexBuffers(const uint32_t *indices, uint32_t indexCount, StagedUpload &upload)
     {
-        indexCount = static_cast<uint32_t>(indices.size());
+        this->indexCount = indexCount;
         hasIndexBuffer = indexCount > 0;
 
         if (!hasIndexBuffer)
             return; // stop the work if we don't have an index buffer anyways
 
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-        uint32_t indexSize = sizeof(indices[0]);
+        // 16 bit indices whenever every index fits, that halves index memory and fetch bandwidth
+        const uint32_t maxIndex = *std::max_element(indices, indices + indexCount);
+        indexType = maxIndex <= std::numeric_limits<uint16_t>::max() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 
-        // create staging buffer to stage to from host mem, and copy from into gpu mem
-        HuhuBuffer stagingBuffer{
-            huhuDevice,
-            indexSize,
-            indexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            };
+        uint32_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        VkDeviceSize bufferSize = indexSize * indexCount;
+
+        // 16 bit indices get narrowed while staging, no extra copy
+        const bool narrowIndices = indexType == VK_INDEX_TYPE_UINT16;
+
+        // the arena's shared index buffer for this index type if there's room, our own one otherwise
+        if (geometryArena && geometryArena->allocateIndices(indexType, indexCount, indexRange))
+        {
+            indexBufferHandle = geometryArena->getBuffer(indexRange);
+            upload.writes.push_back({indices, bufferSize, indexBufferHandle, geometryArena->getByteOffset(indexRange), narrowIndices, true});
+        }
+        else
+        {
+            indexBuffer = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                indexSize,
+                indexCount,
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            indexBufferHandle = indexBuffer->getBuffer();
+            upload.writes.push_back({indices, bufferSize, indexBufferHandle, 0, narrowIndices, false});
+        }
+    }
 
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void *)indices.data());
+    void HuhuModel::createSubmeshes(const Submesh *submeshes, uint32_t submeshCount, const Lod *lods, uint32_t lodCount)
+    {
+        if (!hasIndexBuffer)
+            return;
 
-        // create destination vertex buffer in gpu mem and transfer the data to it
-        indexBuffer = std::make_unique<HuhuBuffer>(
-            huhuDevice,
-            indexSize,
-            indexCount,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (submeshCount == 0)
+            this->submeshes = {Submesh{0, indexCount, 0}};
+        else
+            this->submeshes.assign(submeshes, submeshes + submeshCount);
 
-        huhuDevice.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+        if (lodCount == 0)
+            this->lods = {Lod{0, static_cast<uint32_t>(this->submeshes.size()), 0.f}};
+        else
+            this->lods.assign(lods, lods + lodCount);
     }
 
     void HuhuModel::bind(VkCommandBuffer commandBuffer)
     {
-        VkBuffer buffers[] = {vertexBuffer->getBuffer()};
+        // always bound from the start, arena ranges are reached through firstIndex / vertexOffset when drawing
+        VkBuffer buffers[] = {vertexBufferHandle};
         VkDeviceSize offsets[] = {0};
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
         if (hasIndexBuffer)
         {
-            vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, indexBufferHandle, 0, indexType);
         }
     }
 
-    void HuhuModel::draw(VkCommandBuffer commandBuffer)
+    void HuhuModel::draw(VkCommandBuffer commandBuffer, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance)
     {
         if (hasIndexBuffer)
         {
-            vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+            assert(lod < lods.size() && "lod out of range");
+            const Lod &level = lods[lod];
+            for (uint32_t i = level.firstSubmesh; i < level.firstSubmesh + level.submeshCount; i++)
+            {
+                const Submesh &submesh = submeshes[i];
+                vkCmdDrawIndexed(
+                    commandBuffer,
+                    submesh.indexCount,
+                    instanceCount,
+                    indexRange.first + submesh.firstIndex,
+                    static_cast<int32_t>(vertexRange.first) + submesh.vertexOffset,
+                    firstInstance);
+            }
         }
         else
         {
-            vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, vertexCount, instanceCount, vertexRange.first, firstInstance);
+        }
+    }
+
+    // Calls emit(firstIndex, indexCount, vertexOffset) for every run of visible meshlets. Meshlets sit back to back in
+    // the index buffer, so a run of visible neighbours is a single draw.
+    template <typename Emit>
+    static void forEachMeshletRun(const std::vector<HuhuModel::Meshlet> &meshlets, const uint32_t *visibleMeshlets, uint32_t count, Emit &&emit)
+    {
+        uint32_t i = 0;
+        while (i < count)
+        {
+            const HuhuModel::Meshlet &first = meshlets[visibleMeshlets[i]];
+            uint32_t indexCount = first.indexCount;
+
+            uint32_t next = i + 1;
+            while (next < count)
+            {
+                const HuhuModel::Meshlet &meshlet = meshlets[visibleMeshlets[next]];
+                if (meshlet.firstIndex != first.firstIndex + indexCount || meshlet.vertexOffset != first.vertexOffset)
+                    break;
+                indexCount += meshlet.indexCount;
+                next++;
+            }
+
+            emit(first.firstIndex, indexCount, first.vertexOffset);
+            i = next;
+        }
+    }
+
+    void HuhuModel::drawMeshlets(VkCommandBuffer commandBuffer, const uint32_t *visibleMeshlets, uint32_t count, uint32_t firstInstance)
+    {
+        forEachMeshletRun(
+            meshlets,
+            visibleMeshlets,
+            count,
+            [&](uint32_t firstIndex, uint32_t indexCount, int32_t vertexOffset)
+            {
+                vkCmdDrawIndexed(
+                    commandBuffer,
+                    indexCount,
+                    1,
+                    indexRange.first + firstIndex,
+                    static_cast<int32_t>(vertexRange.first) + vertexOffset,
+                    firstInstance);
+            });
+    }
+
+    uint32_t HuhuModel::writeDrawCommands(VkDrawIndexedIndirectCommand *commands, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) const
+    {
+        assert(hasIndexBuffer && "indirect commands need an index buffer");
+        assert(lod < lods.size() && "lod out of range");
+        const Lod &level = lods[lod];
+        for (uint32_t i = 0; i < level.submeshCount; i++)
+        {
+            const Submesh &submesh = submeshes[level.firstSubmesh + i];
+            commands[i].indexCount = submesh.indexCount;
+            commands[i].instanceCount = instanceCount;
+            commands[i].firstIndex = indexRange.first + submesh.firstIndex;
+            commands[i].vertexOffset = static_cast<int32_t>(vertexRange.first) + submesh.vertexOffset;
+            commands[i].firstInstance = firstInstance;
         }
+        return level.submeshCount;
+    }
+
+    uint32_t HuhuModel::writeMeshletCommands(VkDrawIndexedIndirectCommand *commands, const uint32_t *visibleMeshlets, uint32_t count, uint32_t firstInstance) const
+    {
+        assert(hasIndexBuffer && "indirect commands need an index buffer");
+        uint32_t written = 0;
+        forEachMeshletRun(
+            meshlets,
+            visibleMeshlets,
+            count,
+            [&](uint32_t firstIndex, uint32_t indexCount, int32_t vertexOffset)
+            {
+                VkDrawIndexedIndirectCommand &command = commands[written++];
+                command.indexCount = indexCount;
+                command.instanceCount = 1;
+                command.firstIndex = indexRange.first + firstIndex;
+                command.vertexOffset = static_cast<int32_t>(vertexRange.first) + vertexOffset;
+                command.firstInstance = firstInstance;
+            });
+        return written;
+    }
+
+    uint32_t HuhuModel::selectLod(float unitsToScreen, float maxScreenError) const
+    {
+        // levels only get coarser, so walk down until the next one would be visible
+        uint32_t lod = 0;
+        while (lod + 1 < lods.size() && lods[lod + 1].error * unitsToScreen <= maxScreenError)
+            lod++;
+        return lod;
     }
 
     std::vector<VkVertexInputBindingDescription> HuhuModel::Vertex::getBindingDescriptions()
@@ -154,65 +493,424 @@ namespace huhu
         return attributeDescriptions;
     }
 
+    HuhuModel::PackedVertex HuhuModel::PackedVertex::pack(const Vertex &vertex, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent)
+    {
+        PackedVertex packed{};
+
+        for (int i = 0; i < 3; i++)
+        {
+            // flat axes (e.g. a quad) would divide by zero, everything on them sits at the minimum anyway
+            const float normalized = boundsExtent[i] > 0.f ? (vertex.position[i] - boundsMin[i]) / boundsExtent[i] : 0.f;
+            packed.position[i] = static_cast<uint16_t>(std::round(glm::clamp(normalized, 0.f, 1.f) * 65535.f));
+        }
+
+        packed.color = glm::packUnorm4x8(glm::vec4{vertex.color, 1.f});
+
+        // octahedral mapping: project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper
+        glm::vec2 octahedral{0.f};
+        const float l1Norm = std::abs(vertex.normal.x) + std::abs(vertex.normal.y) + std::abs(vertex.normal.z);
+        if (l1Norm > 0.f)
+        {
+            octahedral = glm::vec2{vertex.normal.x, vertex.normal.y} / l1Norm;
+            if (vertex.normal.z < 0.f)
+            {
+                octahedral = glm::vec2{
+                    (1.f - std::abs(octahedral.y)) * (octahedral.x >= 0.f ? 1.f : -1.f),
+                    (1.f - std::abs(octahedral.x)) * (octahedral.y >= 0.f ? 1.f : -1.f)};
+            }
+        }
+        packed.normal = glm::packSnorm2x16(octahedral);
+
+        packed.uv = glm::packHalf2x16(vertex.uv);
+        return packed;
+    }
+
+    std::vector<VkVertexInputBindingDescription> HuhuModel::PackedVertex::getBindingDescriptions()
+    {
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = sizeof(PackedVertex);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescriptions;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> HuhuModel::PackedVertex::getAttributeDescriptions()
+    {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+        // same locations as Vertex, the normalized formats do the unpacking in the input assembler
+        attributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position)});
+        attributeDescriptions.push_back({1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)});
+        attributeDescriptions.push_back({2, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)});
+        attributeDescriptions.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)});
+
+        return attributeDescriptions;
+    }
+
     void HuhuModel::Builder::loadModel(const std::string &filepath)
     {
         tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
+        std::vector<tinyobj::index_t> objIndices;
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str()))
+        // the parallel loader covers everything our assets use, anything fancier still goes through tinyobj
+        if (!HuhuObjLoader::load(filepath, attrib, objIndices))
         {
-            throw std::runtime_error(warn + err);
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+
+            attrib = tinyobj::attrib_t{};
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str()))
+            {
+                throw std::runtime_error(warn + err);
+            }
+
+            objIndices.clear();
+            for (const auto &shape : shapes) // shapes come in file order, so this is just every face in order
+            {
+                objIndices.insert(objIndices.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+            }
         }
 
         vertices.clear();
+        packedVertices.clear();
         indices.clear();
+        submeshes.clear();
+        lods.clear();
+        meshlets.clear();
+        vertexFormat = VertexFormat::Full;
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+        indices.reserve(objIndices.size());
+        VertexWeldTable weldTable{objIndices.size()};
 
-        for (const auto &shape : shapes) // loop the shapes
+        for (const auto &index : objIndices) // loop through all face corners
         {
-            for (const auto &index : shape.mesh.indices) // loop through all faces in the shape
+            Vertex vertex{};
+
+            if (index.vertex_index >= 0) // negative value would mean no index was provided
+            {
+                vertex.position = {
+                    attrib.vertices[3 * index.vertex_index + 0],
+                    attrib.vertices[3 * index.vertex_index + 1],
+                    attrib.vertices[3 * index.vertex_index + 2]};
+
+                // load colors if they're in the obj file, loads white if not
+                vertex.color = {
+                    attrib.colors[3 * index.vertex_index + 0],
+                    attrib.colors[3 * index.vertex_index + 1],
+                    attrib.colors[3 * index.vertex_index + 2]};
+            }
+
+            if (index.normal_index >= 0)
+            {
+                vertex.normal = {
+                    attrib.normals[3 * index.normal_index + 0],
+                    attrib.normals[3 * index.normal_index + 1],
+                    attrib.normals[3 * index.normal_index + 2]};
+            }
+
+            if (index.texcoord_index >= 0)
             {
-                Vertex vertex{};
+                vertex.uv = {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    attrib.texcoords[2 * index.texcoord_index + 1]};
+            }
+
+            indices.push_back(weldTable.findOrInsert(vertex, vertices)); // only saves the vertex if we haven't seen it yet
+        }
+
+        computeBounds();
+    }
+
+    void HuhuModel::Builder::computeBounds()
+    {
+        if (vertices.empty())
+        {
+            bounds = BoundingBox{};
+            return;
+        }
+
+        bounds.min = glm::vec3{std::numeric_limits<float>::max()};
+        bounds.max = glm::vec3{std::numeric_limits<float>::lowest()};
+        for (const auto &vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.position);
+            bounds.max = glm::max(bounds.max, vertex.position);
+        }
+    }
+
+    std::pair<HuhuModel::VertexCacheStats, HuhuModel::VertexCacheStats> HuhuModel::Builder::optimize()
+    {
+        const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+        const VertexCacheStats before = HuhuMeshOptimizer::analyzeVertexCache(indices, vertexCount);
 
-                if (index.vertex_index >= 0) // negative value would mean no index was provided
+        // order matters, overdraw sorting works on the clusters the cache pass leaves behind and the fetch remap
+        // just follows whatever index order we end up with
+        HuhuMeshOptimizer::optimizeVertexCache(indices, vertexCount);
+        HuhuMeshOptimizer::optimizeOverdraw(indices, vertices);
+        HuhuMeshOptimizer::optimizeVertexFetch(vertices, indices);
+
+        return {before, HuhuMeshOptimizer::analyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()))};
+    }
+
+    void HuhuModel::Builder::splitSubmeshes(uint32_t maxVertexCount)
+    {
+        assert(maxVertexCount >= 3 && "submeshes need room for at least one triangle");
+        submeshes.clear();
+        lods.clear();
+        meshlets.clear();
+        if (vertices.size() <= maxVertexCount)
+            return; // fits as is, a single implicit submesh
+
+        constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+
+        std::vector<Vertex> splitVertices{};
+        std::vector<uint32_t> splitIndices{};
+        splitVertices.reserve(vertices.size());
+        splitIndices.reserve(indices.size());
+
+        // which submesh a vertex was last copied into and where it ended up there
+        std::vector<uint32_t> lastSubmesh(vertices.size(), UNUSED);
+        std::vector<uint32_t> localIndex(vertices.size());
+
+        Submesh submesh{};
+        for (size_t triangle = 0; triangle < indices.size() / 3; triangle++)
+        {
+            const uint32_t *corners = &indices[triangle * 3];
+            const uint32_t submeshId = static_cast<uint32_t>(submeshes.size());
+
+            uint32_t newVertices = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                const bool seenBefore = lastSubmesh[corners[i]] == submeshId || (i > 0 && corners[i] == corners[0]) ||
+                                        (i > 1 && corners[i] == corners[1]);
+                newVertices += seenBefore ? 0 : 1;
+            }
+
+            if (splitVertices.size() - submesh.vertexOffset + newVertices > maxVertexCount)
+            {
+                submeshes.push_back(submesh);
+                submesh.firstIndex = static_cast<uint32_t>(splitIndices.size());
+                submesh.indexCount = 0;
+                submesh.vertexOffset = static_cast<int32_t>(splitVertices.size());
+            }
+
+            const uint32_t currentId = static_cast<uint32_t>(submeshes.size());
+            for (int i = 0; i < 3; i++)
+            {
+                const uint32_t vertex = corners[i];
+                if (lastSubmesh[vertex] != currentId)
                 {
-                    vertex.position = {
-                        attrib.vertices[3 * index.vertex_index + 0],
-                        attrib.vertices[3 * index.vertex_index + 1],
-                        attrib.vertices[3 * index.vertex_index + 2]};
-
-                    // load colors if they're in the obj file, loads white if not
-                    vertex.color = {
-                        attrib.colors[3 * index.vertex_index + 0],
-                        attrib.colors[3 * index.vertex_index + 1],
-                        attrib.colors[3 * index.vertex_index + 2]};
+                    lastSubmesh[vertex] = currentId;
+                    localIndex[vertex] = static_cast<uint32_t>(splitVertices.size() - submesh.vertexOffset);
+                    splitVertices.push_back(vertices[vertex]);
                 }
+                splitIndices.push_back(localIndex[vertex]);
+            }
+            submesh.indexCount += 3;
+        }
+        submeshes.push_back(submesh);
+
+        vertices = std::move(splitVertices);
+        indices = std::move(splitIndices);
+    }
+
+    void HuhuModel::Builder::generateLods(const std::vector<float> &targetErrors)
+    {
+        if (indices.empty())
+            return;
+
+        if (submeshes.empty())
+            submeshes = {Submesh{0, static_cast<uint32_t>(indices.size()), 0}};
+
+        const uint32_t baseSubmeshCount = static_cast<uint32_t>(submeshes.size());
+        lods = {Lod{0, baseSubmeshCount, 0.f}};
+
+        const float modelSize = glm::length(bounds.max - bounds.min);
+        size_t previousIndexCount = indices.size();
+
+        for (float targetError : targetErrors)
+        {
+            Lod lod{static_cast<uint32_t>(submeshes.size()), baseSubmeshCount, 0.f};
+            const size_t lodFirstIndex = indices.size();
 
-                if (index.normal_index >= 0)
+            // always simplify from the full mesh so errors don't stack up from level to level
+            for (uint32_t i = 0; i < baseSubmeshCount; i++)
+            {
+                const Submesh base = submeshes[i];
+                std::vector<uint32_t> baseIndices(indices.begin() + base.firstIndex, indices.begin() + base.firstIndex + base.indexCount);
+                const uint32_t baseVertexCount = *std::max_element(baseIndices.begin(), baseIndices.end()) + 1;
+
+                float error = 0.f;
+                std::vector<uint32_t> lodIndices = HuhuMeshOptimizer::simplify(
+                    baseIndices, vertices.data() + base.vertexOffset, baseVertexCount, targetError * modelSize, error);
+                HuhuMeshOptimizer::optimizeVertexCache(lodIndices, baseVertexCount);
+
+                submeshes.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()), base.vertexOffset});
+                indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+                lod.error = std::max(lod.error, error);
+            }
+
+            const size_t lodIndexCount = indices.size() - lodFirstIndex;
+            if (lodIndexCount >= previousIndexCount)
+            {
+                // nothing gained over the last level, drop it again
+                indices.resize(lodFirstIndex);
+                submeshes.resize(lod.firstSubmesh);
+                continue;
+            }
+
+            previousIndexCount = lodIndexCount;
+            lods.push_back(lod);
+        }
+    }
+
+    void HuhuModel::Builder::buildMeshlets(uint32_t maxVertexCount, uint32_t maxTriangleCount)
+    {
+        meshlets.clear();
+        if (indices.empty())
+            return;
+
+        // the full detail level, however it's currently described
+        std::vector<Submesh> fullDetail{};
+        if (submeshes.empty())
+            fullDetail = {Submesh{0, static_cast<uint32_t>(indices.size()), 0}};
+        else if (lods.empty())
+            fullDetail = submeshes;
+        else
+            fullDetail.assign(submeshes.begin() + lods[0].firstSubmesh, submeshes.begin() + lods[0].firstSubmesh + lods[0].submeshCount);
+
+        std::vector<uint32_t> meshletVertices{};
+        meshletVertices.reserve(maxVertexCount);
+
+        auto finishMeshlet = [&](Meshlet &meshlet)
+        {
+            // sphere around the box center, cheap and close enough for clusters this small
+            glm::vec3 boxMin{std::numeric_limits<float>::max()};
+            glm::vec3 boxMax{std::numeric_limits<float>::lowest()};
+            for (uint32_t vertex : meshletVertices)
+            {
+                boxMin = glm::min(boxMin, vertices[meshlet.vertexOffset + vertex].position);
+                boxMax = glm::max(boxMax, vertices[meshlet.vertexOffset + vertex].position);
+            }
+            meshlet.center = (boxMin + boxMax) * .5f;
+            for (uint32_t vertex : meshletVertices)
+            {
+                meshlet.radius = std::max(meshlet.radius, glm::length(vertices[meshlet.vertexOffset + vertex].position - meshlet.center));
+            }
+
+            // normal cone over the face normals (counter clockwise winding like the obj files)
+            std::vector<glm::vec3> normals{};
+            glm::vec3 axis{0.f};
+            for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+            {
+                const glm::vec3 &p0 = vertices[meshlet.vertexOffset + indices[i]].position;
+                const glm::vec3 &p1 = vertices[meshlet.vertexOffset + indices[i + 1]].position;
+                const glm::vec3 &p2 = vertices[meshlet.vertexOffset + indices[i + 2]].position;
+                const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const float length = glm::length(normal);
+                if (length > 0.f)
                 {
-                    vertex.normal = {
-                        attrib.normals[3 * index.normal_index + 0],
-                        attrib.normals[3 * index.normal_index + 1],
-                        attrib.normals[3 * index.normal_index + 2]};
+                    normals.push_back(normal / length);
+                    axis += normal / length;
                 }
+            }
+
+            const float axisLength = glm::length(axis);
+            float minDot = -1.f;
+            if (axisLength > 0.f)
+            {
+                axis /= axisLength;
+                minDot = 1.f;
+                for (const auto &normal : normals)
+                    minDot = std::min(minDot, glm::dot(axis, normal));
+            }
+
+            if (minDot <= .1f)
+            {
+                // normals spread over (almost) a half sphere, there's no direction this is all back facing from
+                meshlet.coneAxis = glm::vec3{0.f};
+                meshlet.coneCutoff = 1.f;
+            }
+            else
+            {
+                meshlet.coneAxis = axis;
+                meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+            }
+
+            meshlets.push_back(meshlet);
+        };
+
+        for (const Submesh &submesh : fullDetail)
+        {
+            Meshlet meshlet{};
+            meshlet.firstIndex = submesh.firstIndex;
+            meshlet.vertexOffset = submesh.vertexOffset;
+            meshletVertices.clear();
 
-                if (index.texcoord_index >= 0)
+            for (uint32_t i = submesh.firstIndex; i < submesh.firstIndex + submesh.indexCount; i += 3)
+            {
+                uint32_t newVertices = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    const bool known = std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) != meshletVertices.end() ||
+                                       (k > 0 && indices[i + k] == indices[i]) || (k > 1 && indices[i + k] == indices[i + 1]);
+                    newVertices += known ? 0 : 1;
+                }
+
+                if (meshletVertices.size() + newVertices > maxVertexCount || meshlet.indexCount / 3 == maxTriangleCount)
                 {
-                    vertex.uv = {
-                        attrib.texcoords[2 * index.texcoord_index + 0],
-                        attrib.texcoords[2 * index.texcoord_index + 1]};
+                    finishMeshlet(meshlet);
+                    meshlet = Meshlet{};
+                    meshlet.firstIndex = i;
+                    meshlet.vertexOffset = submesh.vertexOffset;
+                    meshletVertices.clear();
                 }
 
-                if (uniqueVertices.count(vertex) == 0) // if we don't know this vertex yet
+                for (int k = 0; k < 3; k++)
                 {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size()); // so next time we remember we've already saved it
-                    vertices.push_back(vertex);
+                    if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end())
+                        meshletVertices.push_back(indices[i + k]);
                 }
-                indices.push_back(uniqueVertices[vertex]);
+                meshlet.indexCount += 3;
             }
+
+            if (meshlet.indexCount > 0)
+                finishMeshlet(meshlet);
         }
     }
+
+    void HuhuModel::Builder::packVertices()
+    {
+        const glm::vec3 extent = bounds.max - bounds.min;
+
+        packedVertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            packedVertices[i] = PackedVertex::pack(vertices[i], bounds.min, extent);
+        }
+        vertexFormat = VertexFormat::Packed;
+    }
+
+    HuhuModel::MeshData HuhuModel::Builder::getMeshData() const
+    {
+        MeshData meshData{};
+        meshData.vertexFormat = vertexFormat;
+        if (vertexFormat == VertexFormat::Packed)
+            meshData.vertices = packedVertices.data();
+        else
+            meshData.vertices = vertices.data();
+        meshData.vertexCount = static_cast<uint32_t>(vertices.size());
+        meshData.indices = indices.data();
+        meshData.indexCount = static_cast<uint32_t>(indices.size());
+        meshData.submeshes = submeshes.data();
+        meshData.submeshCount = static_cast<uint32_t>(submeshes.size());
+        meshData.lods = lods.data();
+        meshData.lodCount = static_cast<uint32_t>(lods.size());
+        meshData.meshlets = meshlets.data();
+        meshData.meshletCount = static_cast<uint32_t>(meshlets.size());
+        meshData.bounds = bounds;
+        return meshData;
+    }
 }
\ No newline at end of file
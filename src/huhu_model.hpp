@@ -2,6 +2,8 @@
 
 #include "huhu_device.hpp"
 #include "huhu_buffer.hpp"
+#include "huhu_geometry_arena.hpp"
+#include "huhu_staging_ring.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS           // make glm use radians over degrees on every OS
@@ -10,10 +12,33 @@
 
 // std
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace huhu
 {
+    enum class VertexFormat : uint32_t
+    {
+        Full,  // HuhuModel::Vertex, plain floats
+        Packed // HuhuModel::PackedVertex, needs the matching pipeline and getPositionDecodeMatrix()
+    };
+
+    struct ModelConfigInfo
+    {
+        // reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+        bool optimizeMesh = false;
+        VertexFormat vertexFormat = VertexFormat::Full;
+        // split meshes with more than 65536 vertices into submeshes so they can still use 16 bit indices
+        bool splitSubmeshes = false;
+        // one extra detail level per entry, simplified until it strays this far from the original mesh (relative
+        // to the bounds diagonal, so .01f is 1% of the model's size)
+        std::vector<float> lodTargetErrors{};
+        // partition the full detail level into meshlets so the renderer can cull parts of a mesh
+        bool buildMeshlets = false;
+        // where the buffers go, models get their own if this is null or full (doesn't change the baked mesh)
+        HuhuGeometryArena *geometryArena = nullptr;
+    };
+
     class HuhuModel
     {
     public:
@@ -36,36 +61,217 @@ namespace huhu
             }
         };
 
+        // 20 instead of 44 bytes. Positions are quantized against the model bounds, the shader gets them back through
+        // the model matrix (see getPositionDecodeMatrix), so there is nothing extra to decode per vertex.
+        struct PackedVertex
+        {
+            uint16_t position[4]{}; // unorm16 within the bounds, w is padding
+            uint32_t color = 0;     // rgba8 unorm
+            uint32_t normal = 0;    // octahedral encoded, 2x snorm16
+            uint32_t uv = 0;        // 2x half float
+
+            static PackedVertex pack(const Vertex &vertex, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent);
+
+            static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+            static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        };
+
+        struct BoundingBox
+        {
+            glm::vec3 min{};
+            glm::vec3 max{};
+        };
+
+        // range of the index buffer drawn with its own vertexOffset, indices inside are relative to that offset
+        struct Submesh
+        {
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            int32_t vertexOffset = 0;
+        };
+
+        // a detail level is a run of submeshes, error is how far it strays from the full mesh in model units
+        struct Lod
+        {
+            uint32_t firstSubmesh = 0;
+            uint32_t submeshCount = 0;
+            float error = 0.f;
+        };
+
+        // Consecutive run of triangles in the full detail level, small enough (64 vertices, 124 triangles) to be worth
+        // culling on its own. Bounds are in model space.
+        struct Meshlet
+        {
+            glm::vec3 center{}; // bounding sphere
+            float radius = 0.f;
+            glm::vec3 coneAxis{}; // every triangle normal lies within the cone around this axis
+            float coneCutoff = 1.f; // back facing if dot(center - eye, axis) >= cutoff * |center - eye| + radius, 1 never is
+            uint32_t firstIndex = 0;
+            uint32_t indexCount = 0;
+            int32_t vertexOffset = 0;
+        };
+
+        // average cache miss ratio (misses per triangle) and average transformed vertex ratio (misses per vertex)
+        struct VertexCacheStats
+        {
+            float acmr = 0.f;
+            float atvr = 0.f;
+        };
+
+        // non-owning view of everything needed to upload a model, e.g. a Builder or a memory mapped mesh cache
+        struct MeshData
+        {
+            VertexFormat vertexFormat = VertexFormat::Full;
+            const void *vertices = nullptr; // Vertex or PackedVertex depending on vertexFormat
+            uint32_t vertexCount = 0;
+            const uint32_t *indices = nullptr;
+            uint32_t indexCount = 0;
+            const Submesh *submeshes = nullptr; // none means the whole index buffer is one submesh at offset 0
+            uint32_t submeshCount = 0;
+            const Lod *lods = nullptr; // none means a single level made of all submeshes
+            uint32_t lodCount = 0;
+            const Meshlet *meshlets = nullptr;
+            uint32_t meshletCount = 0;
+            BoundingBox bounds{};
+        };
+
         struct Builder
         {
             std::vector<Vertex> vertices{};
+            std::vector<PackedVertex> packedVertices{}; // only filled by packVertices()
             std::vector<uint32_t> indices{};
+            std::vector<Submesh> submeshes{}; // only filled by splitSubmeshes() and generateLods()
+            std::vector<Lod> lods{};          // only filled by generateLods()
+            std::vector<Meshlet> meshlets{};  // only filled by buildMeshlets()
+            BoundingBox bounds{};
+            VertexFormat vertexFormat = VertexFormat::Full;
 
             void loadModel(const std::string &filepath);
+            void computeBounds();
+            // returns the FIFO cache stats from before and after reordering
+            std::pair<VertexCacheStats, VertexCacheStats> optimize();
+            // Regroups vertices and indices into submeshes of at most maxVertexCount vertices each, duplicating the
+            // ones shared across a split. Indices become relative to their submesh, so run this after optimize().
+            void splitSubmeshes(uint32_t maxVertexCount = 65536);
+            // Appends a simplified copy of every submesh per target error (relative to the bounds diagonal) and records
+            // them as detail levels, sharing the vertices of the full mesh. Levels that don't come out any smaller than
+            // the one before are skipped. Run after optimize() and splitSubmeshes().
+            void generateLods(const std::vector<float> &targetErrors);
+            // Cuts the full detail level into meshlets in index order, so the index buffer stays as it is. Run after
+            // optimize() so the runs are cache friendly to begin with.
+            void buildMeshlets(uint32_t maxVertexCount = 64, uint32_t maxTriangleCount = 124);
+            // fills packedVertices from vertices and switches getMeshData() over to them, do this last
+            void packVertices();
+            MeshData getMeshData() const;
+        };
+
+        // What has to end up in the vertex and index buffers, and how much of it is staged already. Lets the upload be
+        // staged and recorded somewhere else than the thread that built the model (see HuhuAssetLoader). The writes
+        // point into the mesh data, which has to stay alive until everything is staged, source can hold on to it.
+        struct StagedUpload
+        {
+            struct Write
+            {
+                const void *data;
+                VkDeviceSize size; // bytes in the destination
+                VkBuffer dstBuffer;
+                VkDeviceSize dstOffset;
+                bool narrowIndices;     // data holds uint32_t indices that get written as uint16_t
+                bool sharedDestination; // arena buffer with concurrent sharing, no queue ownership to hand over
+                VkDeviceSize stagedSize = 0;
+            };
+
+            // a copy out of the device's staging ring
+            struct Copy
+            {
+                VkDeviceSize srcOffset;
+                VkBuffer dstBuffer;
+                VkDeviceSize dstOffset;
+                VkDeviceSize size;
+                bool sharedDestination;
+                bool lastChunk; // the write is complete once this one has run
+            };
+
+            // Stages as much as the ring has room for, in pieces of at most getMaxChunkSize(), and appends the copies
+            // that have to run for it. Returns true once everything is staged.
+            bool stage(HuhuStagingRing &ring, std::vector<Copy> &copies);
+
+            std::shared_ptr<const void> source{};
+            std::vector<Write> writes{};
         };
 
         HuhuModel(HuhuDevice &device, const HuhuModel::Builder &builder);
+        HuhuModel(HuhuDevice &device, const HuhuModel::MeshData &meshData);
+        // creates the buffers but leaves staging and the copies to the caller, safe to call off the render thread
+        HuhuModel(HuhuDevice &device, const HuhuModel::MeshData &meshData, StagedUpload &upload, HuhuGeometryArena *geometryArena = nullptr);
         ~HuhuModel();
 
         HuhuModel(const HuhuModel &) = delete;
         HuhuModel &operator=(const HuhuModel &) = delete;
 
-        static std::unique_ptr<HuhuModel> createModelFromFile(HuhuDevice &device, const std::string &filepath);
+        static std::unique_ptr<HuhuModel> createModelFromFile(HuhuDevice &device, const std::string &filepath, const ModelConfigInfo &configInfo = ModelConfigInfo{});
+        static std::unique_ptr<HuhuModel> createModelFromFile(HuhuDevice &device, const std::string &filepath, const ModelConfigInfo &configInfo, StagedUpload &upload);
 
         void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        // firstInstance is what gl_InstanceIndex starts at
+        void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+        // Coarsest level whose error stays below maxScreenError once scaled by unitsToScreen (how much of the
+        // screen one model space unit covers right now). Level 0 is the full mesh.
+        uint32_t selectLod(float unitsToScreen, float maxScreenError) const;
+        uint32_t getLodCount() const { return static_cast<uint32_t>(lods.size()); }
+
+        const std::vector<Meshlet> &getMeshlets() const { return meshlets; }
+        // draws the given meshlets (ascending indices into getMeshlets()), neighbours get merged into one draw
+        void drawMeshlets(VkCommandBuffer commandBuffer, const uint32_t *visibleMeshlets, uint32_t count, uint32_t firstInstance = 0);
+
+        // The same draws as draw() and drawMeshlets(), written out as indirect commands instead of recorded. Only for
+        // models with an index buffer, returns the number of commands written (at most getDrawCommandCount(lod) or
+        // count).
+        uint32_t getDrawCommandCount(uint32_t lod) const { return lods[lod].submeshCount; }
+        uint32_t writeDrawCommands(VkDrawIndexedIndirectCommand *commands, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) const;
+        uint32_t writeMeshletCommands(VkDrawIndexedIndirectCommand *commands, const uint32_t *visibleMeshlets, uint32_t count, uint32_t firstInstance) const;
+        bool isIndexed() const { return hasIndexBuffer; }
+
+        const BoundingBox &getBounds() const { return bounds; }
+        VertexFormat getVertexFormat() const { return vertexFormat; }
+        VkIndexType getIndexType() const { return indexType; }
+        // models in the same arena pool share these, so they only need binding once
+        VkBuffer getVertexBuffer() const { return vertexBufferHandle; }
+        VkBuffer getIndexBuffer() const { return indexBufferHandle; }
+        const std::vector<Submesh> &getSubmeshes() const { return submeshes; }
+        // maps packed unorm positions back into model space, identity for VertexFormat::Full
+        const glm::mat4 &getPositionDecodeMatrix() const { return positionDecodeMatrix; }
+
+        static uint32_t getVertexStride(VertexFormat vertexFormat);
+        // device local bytes held by the vertex and index buffers
+        VkDeviceSize getMemorySize() const;
 
     private:
-        void createVertexBuffers(const std::vector<Vertex> &vertices);
-        void createIndexBuffers(const std::vector<uint32_t> &indices);
+        void createBuffers(const MeshData &meshData, StagedUpload &upload);
+        void createVertexBuffers(const void *vertices, uint32_t vertexSize, uint32_t vertexCount, StagedUpload &upload);
+        void createIndexBuffers(const uint32_t *indices, uint32_t indexCount, StagedUpload &upload);
+        void createSubmeshes(const Submesh *submeshes, uint32_t submeshCount, const Lod *lods, uint32_t lodCount);
 
         HuhuDevice &huhuDevice;
+        HuhuGeometryArena *geometryArena = nullptr;
+        BoundingBox bounds{};
+        VertexFormat vertexFormat = VertexFormat::Full;
+        glm::mat4 positionDecodeMatrix{1.f};
 
-        std::unique_ptr<HuhuBuffer> vertexBuffer; 
+        std::unique_ptr<HuhuBuffer> vertexBuffer; // null when the vertices live in the arena
+        GeometryRange vertexRange{};
+        VkBuffer vertexBufferHandle = VK_NULL_HANDLE;
         uint32_t vertexCount;
 
         bool hasIndexBuffer = false;
-        std::unique_ptr<HuhuBuffer> indexBuffer;
+        std::unique_ptr<HuhuBuffer> indexBuffer; // null when the indices live in the arena
+        GeometryRange indexRange{};
+        VkBuffer indexBufferHandle = VK_NULL_HANDLE;
         uint32_t indexCount;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+        std::vector<Submesh> submeshes{};
+        std::vector<Lod> lods{};
+        std::vector<Meshlet> meshlets{};
     };
 }
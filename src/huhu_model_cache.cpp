@@ -0,0 +1,193 @@
+#include "huhu_model_cache.hpp"
+
+#include "huhu_mapped_file.hpp"
+#include "huhu_mesh_cache.hpp"
+#include "huhu_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace huhu
+{
+    namespace
+    {
+        // 64 bit hash of the file contents, a word at a time. Reads the whole file, so keep it off the render thread.
+        // Throws if the file can't be mapped.
+        uint64_t hashFileContents(const std::string &filepath)
+        {
+            HuhuMappedFile file{filepath};
+            uint64_t hash = 0x9e3779b97f4a7c15ull ^ file.size();
+
+            const size_t wordCount = file.size() / sizeof(uint64_t);
+            for (size_t i = 0; i < wordCount; i++)
+            {
+                uint64_t word;
+                memcpy(&word, file.data() + i * sizeof(uint64_t), sizeof(word));
+                hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+                hash ^= hash >> 32;
+            }
+
+            uint64_t tail = 0;
+            if (file.size() % sizeof(uint64_t) != 0)
+                memcpy(&tail, file.data() + wordCount * sizeof(uint64_t), file.size() % sizeof(uint64_t));
+            hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+            hash ^= hash >> 29;
+            return hash;
+        }
+
+        // size and mtime, so an edited file isn't mistaken for the one we loaded before. Just a stat, fine to do here.
+        std::string stampFor(const std::string &filepath)
+        {
+            std::error_code ec;
+            const auto size = std::filesystem::file_size(filepath, ec);
+            if (ec)
+                return {};
+            const auto modified = std::filesystem::last_write_time(filepath, ec);
+            if (ec)
+                return {};
+            return std::to_string(size) + "|" + std::to_string(modified.time_since_epoch().count());
+        }
+    }
+
+    HuhuModelCache::HuhuModelCache(HuhuAssetLoader &assetLoader, VkDeviceSize memoryBudget, HuhuThreadPool &threadPool)
+        : assetLoader{assetLoader}, threadPool{threadPool}, memoryBudget{memoryBudget} {}
+
+    HuhuAssetLoader::ModelHandle HuhuModelCache::acquire(const std::string &filepath, const ModelConfigInfo &configInfo)
+    {
+        const std::string configKey = std::to_string(HuhuMeshCache::configKeyFor(configInfo));
+
+        std::error_code ec;
+        std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(filepath, ec);
+        const std::string pathKey = (ec ? filepath : canonicalPath.string()) + "|" + stampFor(filepath) + "|" + configKey;
+
+        auto byPath = entriesByPath.find(pathKey);
+        if (byPath != entriesByPath.end())
+        {
+            byPath->second->lastReferencedFrame = frameNumber;
+            return byPath->second->handle;
+        }
+
+        // Unknown path, it might still be a copy of something we already have. Finding that out means reading the
+        // whole file, so it's hashed on the pool while the loader parses and update() merges the two if it is.
+        Entry entry{};
+        entry.handle = assetLoader.loadModel(filepath, configInfo);
+        entry.pathKeys.push_back(pathKey);
+        entry.configKey = configKey;
+        entry.contentHash = threadPool.submit([filepath]()
+                                              { return hashFileContents(filepath); });
+        entry.lastReferencedFrame = frameNumber;
+
+        auto inserted = entries.insert(entries.end(), std::move(entry));
+        entriesByPath.emplace(pathKey, inserted);
+        return inserted->handle;
+    }
+
+    bool HuhuModelCache::resolveContentKey(std::list<Entry>::iterator entry)
+    {
+        uint64_t contentHash;
+        try
+        {
+            contentHash = entry->contentHash.get();
+        }
+        catch (const std::runtime_error &)
+        {
+            return true; // unreadable, the loader fails on it too
+        }
+
+        const std::string contentKey = std::to_string(contentHash) + "|" + entry->configKey;
+        auto byContent = entriesByContent.find(contentKey);
+        if (byContent == entriesByContent.end())
+        {
+            entry->contentKey = contentKey;
+            entriesByContent.emplace(contentKey, entry);
+            return true;
+        }
+
+        // A copy, its paths now lead to the original. Handles already given out for the copy keep it alive until
+        // they're dropped, the cache just stops holding on to it.
+        auto original = byContent->second;
+        for (const auto &pathKey : entry->pathKeys)
+        {
+            original->pathKeys.push_back(pathKey);
+            entriesByPath[pathKey] = original;
+        }
+        entry->pathKeys.clear();
+        original->lastReferencedFrame = std::max(original->lastReferencedFrame, entry->lastReferencedFrame);
+        evict(entry);
+        return false;
+    }
+
+    bool HuhuModelCache::isReferenced(const Entry &entry) const
+    {
+        // the cache holds one reference to the handle state, and the state one to the model
+        const auto &state = entry.handle.state;
+        return state.use_count() > 1 || (state->model && state->model.use_count() > 1);
+    }
+
+    void HuhuModelCache::update()
+    {
+        frameNumber++;
+
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            auto entry = it++;
+            if (entry->contentHash.valid() && entry->contentHash.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+            {
+                if (!resolveContentKey(entry))
+                    continue; // merged away
+            }
+
+            const HuhuAssetLoader::Status status = entry->handle.getStatus();
+            if (status == HuhuAssetLoader::Status::Failed)
+            {
+                evict(entry); // forget it so a later acquire tries again
+                continue;
+            }
+
+            if (status == HuhuAssetLoader::Status::Resident && entry->memorySize == 0)
+            {
+                entry->memorySize = entry->handle.getModel()->getMemorySize();
+                residentBytes += entry->memorySize;
+            }
+            if (isReferenced(*entry))
+                entry->lastReferencedFrame = frameNumber;
+        }
+
+        if (residentBytes <= memoryBudget)
+            return;
+
+        std::vector<std::list<Entry>::iterator> candidates{};
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            const bool retired = frameNumber - it->lastReferencedFrame >= HuhuSwapChain::MAX_FRAMES_IN_FLIGHT;
+            if (it->memorySize > 0 && retired && !isReferenced(*it))
+                candidates.push_back(it);
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b)
+                  { return a->lastReferencedFrame < b->lastReferencedFrame; });
+
+        for (auto candidate : candidates)
+        {
+            if (residentBytes <= memoryBudget)
+                break;
+            evict(candidate);
+        }
+    }
+
+    void HuhuModelCache::evict(std::list<Entry>::iterator entry)
+    {
+        for (const auto &pathKey : entry->pathKeys)
+        {
+            entriesByPath.erase(pathKey);
+        }
+        if (!entry->contentKey.empty())
+            entriesByContent.erase(entry->contentKey);
+
+        residentBytes -= entry->memorySize;
+        entries.erase(entry); // last reference, takes the buffers with it
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "huhu_asset_loader.hpp"
+#include "huhu_thread_pool.hpp"
+
+// std
+#include <cstdint>
+#include <future>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace huhu
+{
+    // Hands out shared handles so every file (per config) is only parsed and uploaded once. acquire() only looks at
+    // the canonical path and the file's size and mtime, so it never reads the file on the render thread. The content
+    // hash is computed on the thread pool next to the parse, and update() folds copies of the same asset under another
+    // name into the entry that was there first.
+    // Models nobody references anymore stay around for reuse and only get unloaded, least recently used first, once
+    // the resident total goes over the memory budget.
+    class HuhuModelCache
+    {
+    public:
+        HuhuModelCache(HuhuAssetLoader &assetLoader, VkDeviceSize memoryBudget = 256ull * 1024 * 1024, HuhuThreadPool &threadPool = HuhuThreadPool::shared());
+
+        HuhuModelCache(const HuhuModelCache &) = delete;
+        HuhuModelCache &operator=(const HuhuModelCache &) = delete;
+
+        HuhuAssetLoader::ModelHandle acquire(const std::string &filepath, const ModelConfigInfo &configInfo = ModelConfigInfo{});
+
+        // Call once per frame after HuhuAssetLoader::update(). Unreferenced models are only unloaded after they
+        // have gone unused for MAX_FRAMES_IN_FLIGHT frames, since earlier frames might still be drawing them.
+        void update();
+
+        void setMemoryBudget(VkDeviceSize memoryBudget) { this->memoryBudget = memoryBudget; }
+        VkDeviceSize getMemoryBudget() const { return memoryBudget; }
+        VkDeviceSize getResidentBytes() const { return residentBytes; }
+        size_t getEntryCount() const { return entries.size(); }
+
+    private:
+        struct Entry
+        {
+            HuhuAssetLoader::ModelHandle handle;
+            std::vector<std::string> pathKeys{}; // every path it was requested under
+            std::string configKey{};
+            std::future<uint64_t> contentHash{}; // valid until update() has picked it up
+            std::string contentKey{}; // empty until hashed, or if the file couldn't be read (the loader reports that)
+            VkDeviceSize memorySize = 0; // known once resident
+            uint64_t lastReferencedFrame = 0;
+        };
+
+        // returns false if the entry was a copy and got merged into the original
+        bool resolveContentKey(std::list<Entry>::iterator entry);
+        bool isReferenced(const Entry &entry) const;
+        void evict(std::list<Entry>::iterator entry);
+
+        HuhuAssetLoader &assetLoader;
+        HuhuThreadPool &threadPool;
+        VkDeviceSize memoryBudget;
+        VkDeviceSize residentBytes = 0;
+        uint64_t frameNumber = 0;
+
+        std::list<Entry> entries{}; // stable iterators for the lookups below
+        std::unordered_map<std::string, std::list<Entry>::iterator> entriesByPath{};
+        std::unordered_map<std::string, std::list<Entry>::iterator> entriesByContent{};
+    };
+}
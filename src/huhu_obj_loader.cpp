@@ -0,0 +1,514 @@
+#include "huhu_obj_loader.hpp"
+
+#include "huhu_mapped_file.hpp"
+#include "huhu_thread_pool.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace huhu
+{
+    namespace
+    {
+        // below this a single thread is faster than waking the pool
+        constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+        constexpr uint8_t RELATIVE_V = 1 << 0;
+        constexpr uint8_t RELATIVE_VT = 1 << 1;
+        constexpr uint8_t RELATIVE_VN = 1 << 2;
+
+        // one face corner as written in the file; relative (negative) indices are only resolved once every chunk
+        // knows how many records came before it
+        struct RawCorner
+        {
+            int32_t v;
+            int32_t vt;
+            int32_t vn;
+            uint8_t relative;
+        };
+
+        struct ObjChunk
+        {
+            const char *begin;
+            const char *end;
+
+            std::vector<float> positions{};
+            std::vector<float> colors{};
+            std::vector<float> normals{};
+            std::vector<float> texcoords{};
+            std::vector<RawCorner> corners{};
+            std::vector<uint8_t> faceSizes{}; // 3 or 4
+            bool supported = true;
+
+            size_t firstPosition = 0;
+            size_t firstNormal = 0;
+            size_t firstTexcoord = 0;
+            size_t firstIndex = 0;
+        };
+
+        bool isSpace(char c) { return c == ' ' || c == '\t'; }
+        bool isDigit(char c) { return static_cast<unsigned int>(c - '0') < 10u; }
+        bool isDelimiter(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        const char *skipSpaces(const char *cur, const char *end)
+        {
+            while (cur < end && isSpace(*cur))
+                cur++;
+            return cur;
+        }
+
+        // Same arithmetic as tinyobj's tryParseDouble, step for step, so we round to the exact same floats. It only
+        // differs in being bounded by the token end instead of peeking at a null terminated line.
+        bool parseDouble(const char *s, const char *end, double &result)
+        {
+            if (s >= end)
+                return false;
+
+            double mantissa = 0.0;
+            int exponent = 0;
+            char sign = '+';
+            char exponentSign = '+';
+            const char *cur = s;
+            int read = 0;
+            bool leadingDecimalDot = false;
+
+            if (*cur == '+' || *cur == '-')
+            {
+                sign = *cur;
+                cur++;
+                leadingDecimalDot = cur != end && *cur == '.';
+            }
+            else if (*cur == '.')
+            {
+                leadingDecimalDot = true;
+            }
+            else if (!isDigit(*cur))
+            {
+                return false;
+            }
+
+            if (!leadingDecimalDot)
+            {
+                while (cur != end && isDigit(*cur))
+                {
+                    mantissa *= 10;
+                    mantissa += static_cast<int>(*cur - '0');
+                    cur++;
+                    read++;
+                }
+                if (read == 0)
+                    return false;
+            }
+
+            if (cur != end && *cur == '.')
+            {
+                static const double powLut[] = {1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+                constexpr int lutEntries = sizeof(powLut) / sizeof(powLut[0]);
+
+                cur++;
+                read = 1;
+                while (cur != end && isDigit(*cur))
+                {
+                    mantissa += static_cast<int>(*cur - '0') * (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+                    read++;
+                    cur++;
+                }
+            }
+
+            if (cur != end && (*cur == 'e' || *cur == 'E'))
+            {
+                cur++;
+                if (cur != end && (*cur == '+' || *cur == '-'))
+                {
+                    exponentSign = *cur;
+                    cur++;
+                }
+                else if (cur == end || !isDigit(*cur))
+                {
+                    return false; // empty exponent
+                }
+
+                read = 0;
+                while (cur != end && isDigit(*cur))
+                {
+                    if (exponent > (2147483647 / 10))
+                        return false; // overflow
+                    exponent *= 10;
+                    exponent += static_cast<int>(*cur - '0');
+                    cur++;
+                    read++;
+                }
+                exponent *= (exponentSign == '+' ? 1 : -1);
+                if (read == 0)
+                    return false;
+            }
+
+            result = (sign == '+' ? 1 : -1) *
+                     (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+            return true;
+        }
+
+        bool tryParseFloat(const char *&cur, const char *end, float &out)
+        {
+            cur = skipSpaces(cur, end);
+            const char *tokenEnd = cur;
+            while (tokenEnd < end && !isDelimiter(*tokenEnd))
+                tokenEnd++;
+
+            double value;
+            bool parsed = parseDouble(cur, tokenEnd, value);
+            if (parsed)
+                out = static_cast<float>(value);
+            cur = tokenEnd;
+            return parsed;
+        }
+
+        float parseFloat(const char *&cur, const char *end, float defaultValue)
+        {
+            float value = defaultValue;
+            tryParseFloat(cur, end, value);
+            return value;
+        }
+
+        // atoi, but it never runs past the line
+        int parseInt(const char *cur, const char *end)
+        {
+            while (cur < end && (isSpace(*cur) || *cur == '\v' || *cur == '\f'))
+                cur++;
+
+            bool negative = false;
+            if (cur < end && (*cur == '+' || *cur == '-'))
+            {
+                negative = *cur == '-';
+                cur++;
+            }
+
+            long value = 0;
+            while (cur < end && isDigit(*cur))
+            {
+                value = value * 10 + (*cur - '0');
+                cur++;
+            }
+            return static_cast<int>(negative ? -value : value);
+        }
+
+        const char *skipIndex(const char *cur, const char *end)
+        {
+            while (cur < end && *cur != '/' && !isDelimiter(*cur))
+                cur++;
+            return cur;
+        }
+
+        // mirrors tinyobj's fixIndex, except that relative indices stay relative to the chunk for now
+        bool fixIndex(int index, size_t localCount, bool allowZero, int32_t &out, uint8_t &relative, uint8_t relativeBit)
+        {
+            if (index > 0)
+            {
+                out = index - 1;
+                return true;
+            }
+            if (index == 0)
+            {
+                out = -1;
+                return allowZero;
+            }
+            out = static_cast<int32_t>(localCount) + index;
+            relative |= relativeBit;
+            return true;
+        }
+
+        // i, i/j, i//k, i/j/k
+        bool parseCorner(const char *&cur, const char *end, const ObjChunk &chunk, RawCorner &corner)
+        {
+            corner = {-1, -1, -1, 0};
+
+            if (!fixIndex(parseInt(cur, end), chunk.positions.size() / 3, false, corner.v, corner.relative, RELATIVE_V))
+                return false;
+
+            cur = skipIndex(cur, end);
+            if (cur == end || *cur != '/')
+                return true;
+            cur++;
+
+            if (cur != end && *cur == '/')
+            {
+                cur++;
+                if (!fixIndex(parseInt(cur, end), chunk.normals.size() / 3, true, corner.vn, corner.relative, RELATIVE_VN))
+                    return false;
+                cur = skipIndex(cur, end);
+                return true;
+            }
+
+            if (!fixIndex(parseInt(cur, end), chunk.texcoords.size() / 2, true, corner.vt, corner.relative, RELATIVE_VT))
+                return false;
+
+            cur = skipIndex(cur, end);
+            if (cur == end || *cur != '/')
+                return true;
+            cur++;
+
+            if (!fixIndex(parseInt(cur, end), chunk.normals.size() / 3, true, corner.vn, corner.relative, RELATIVE_VN))
+                return false;
+            cur = skipIndex(cur, end);
+            return true;
+        }
+
+        void parseVertex(const char *cur, const char *end, ObjChunk &chunk)
+        {
+            float x = parseFloat(cur, end, 0.f);
+            float y = parseFloat(cur, end, 0.f);
+            float z = parseFloat(cur, end, 0.f);
+
+            // same quirks as tinyobj's parseVertexWithColor: 'x y z w' keeps w as red, anything short of full rgb is white
+            float r, g, b;
+            if (!tryParseFloat(cur, end, r))
+            {
+                r = g = b = 1.f;
+            }
+            else if (!tryParseFloat(cur, end, g))
+            {
+                g = b = 1.f;
+            }
+            else if (!tryParseFloat(cur, end, b))
+            {
+                r = g = b = 1.f;
+            }
+
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+            chunk.colors.insert(chunk.colors.end(), {r, g, b});
+        }
+
+        void parseChunk(ObjChunk &chunk)
+        {
+            const char *cur = chunk.begin;
+            while (cur < chunk.end)
+            {
+                const char *newline = static_cast<const char *>(memchr(cur, '\n', chunk.end - cur));
+                const char *lineEnd = newline ? newline : chunk.end;
+                const char *next = newline ? newline + 1 : chunk.end;
+
+                if (lineEnd > cur && lineEnd[-1] == '\r')
+                    lineEnd--;
+                if (memchr(cur, '\r', lineEnd - cur))
+                {
+                    chunk.supported = false; // lone '\r' line endings, tinyobj splits lines on those
+                    return;
+                }
+
+                const char *token = skipSpaces(cur, lineEnd);
+                const size_t length = lineEnd - token;
+                cur = next;
+
+                if (length < 2 || token[0] == '#')
+                    continue;
+
+                if (token[0] == 'v' && isSpace(token[1]))
+                {
+                    parseVertex(token + 2, lineEnd, chunk);
+                }
+                else if (token[0] == 'v' && token[1] == 'n' && length > 2 && isSpace(token[2]))
+                {
+                    const char *values = token + 3;
+                    float x = parseFloat(values, lineEnd, 0.f);
+                    float y = parseFloat(values, lineEnd, 0.f);
+                    float z = parseFloat(values, lineEnd, 0.f);
+                    chunk.normals.insert(chunk.normals.end(), {x, y, z});
+                }
+                else if (token[0] == 'v' && token[1] == 't' && length > 2 && isSpace(token[2]))
+                {
+                    const char *values = token + 3;
+                    float u = parseFloat(values, lineEnd, 0.f);
+                    float v = parseFloat(values, lineEnd, 0.f);
+                    chunk.texcoords.insert(chunk.texcoords.end(), {u, v});
+                }
+                else if (token[0] == 'f' && isSpace(token[1]))
+                {
+                    const char *corners = skipSpaces(token + 2, lineEnd);
+                    const size_t firstCorner = chunk.corners.size();
+
+                    while (corners < lineEnd)
+                    {
+                        RawCorner corner;
+                        if (!parseCorner(corners, lineEnd, chunk, corner))
+                        {
+                            chunk.supported = false; // zero vertex index, tinyobj reports that as an error
+                            return;
+                        }
+                        chunk.corners.push_back(corner);
+
+                        while (corners < lineEnd && isDelimiter(*corners))
+                            corners++;
+                    }
+
+                    const size_t faceSize = chunk.corners.size() - firstCorner;
+                    if (faceSize < 3)
+                    {
+                        chunk.corners.resize(firstCorner); // degenerate face, tinyobj drops those too
+                    }
+                    else if (faceSize > 4)
+                    {
+                        chunk.supported = false; // n-gons go through tinyobj's ear clipping
+                        return;
+                    }
+                    else
+                    {
+                        chunk.faceSizes.push_back(static_cast<uint8_t>(faceSize));
+                    }
+                }
+                // everything else (groups, materials, smoothing, lines) doesn't change the triangle list
+            }
+        }
+
+        bool resolveCorner(const RawCorner &raw, const ObjChunk &chunk, const tinyobj::attrib_t &attrib, tinyobj::index_t &index)
+        {
+            index.vertex_index = raw.v + ((raw.relative & RELATIVE_V) ? static_cast<int>(chunk.firstPosition) : 0);
+            index.texcoord_index = raw.vt + ((raw.relative & RELATIVE_VT) ? static_cast<int>(chunk.firstTexcoord) : 0);
+            index.normal_index = raw.vn + ((raw.relative & RELATIVE_VN) ? static_cast<int>(chunk.firstNormal) : 0);
+
+            // the old path would read out of bounds on any of these, let tinyobj produce its warnings instead
+            return index.vertex_index >= 0 && static_cast<size_t>(index.vertex_index) < attrib.vertices.size() / 3 &&
+                   index.texcoord_index >= -1 && index.texcoord_index < static_cast<int>(attrib.texcoords.size() / 2) &&
+                   index.normal_index >= -1 && index.normal_index < static_cast<int>(attrib.normals.size() / 3) &&
+                   ((raw.relative & RELATIVE_VT) == 0 || index.texcoord_index >= 0) &&
+                   ((raw.relative & RELATIVE_VN) == 0 || index.normal_index >= 0);
+        }
+
+        template <typename T>
+        void copyInto(std::vector<T> &destination, const std::vector<T> &source, size_t offset)
+        {
+            std::copy(source.begin(), source.end(), destination.begin() + offset);
+        }
+    }
+
+    bool HuhuObjLoader::load(const std::string &filepath, tinyobj::attrib_t &attrib, std::vector<tinyobj::index_t> &indices)
+    {
+        HuhuMappedFile file{filepath};
+        HuhuThreadPool &pool = HuhuThreadPool::shared();
+
+        // split into line aligned chunks, a few per thread so uneven chunks still balance out
+        const char *fileBegin = file.data();
+        const char *fileEnd = file.data() + file.size();
+        const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(pool.getThreadCount() * 4, file.size() / MIN_CHUNK_SIZE));
+
+        std::vector<ObjChunk> chunks{};
+        const char *chunkBegin = fileBegin;
+        for (size_t i = 1; i <= chunkCount && chunkBegin < fileEnd; i++)
+        {
+            const char *chunkEnd = fileEnd;
+            if (i < chunkCount)
+            {
+                chunkEnd = std::max(chunkBegin, fileBegin + file.size() * i / chunkCount);
+                const char *newline = static_cast<const char *>(memchr(chunkEnd, '\n', fileEnd - chunkEnd));
+                chunkEnd = newline ? newline + 1 : fileEnd;
+            }
+            chunks.push_back(ObjChunk{chunkBegin, chunkEnd});
+            chunkBegin = chunkEnd;
+        }
+
+        pool.parallelFor(chunks.size(), [&chunks](size_t i)
+                         { parseChunk(chunks[i]); });
+
+        // prefix sums so every chunk knows where its records end up in the merged arrays
+        size_t positionCount = 0, normalCount = 0, texcoordCount = 0, indexCount = 0;
+        for (auto &chunk : chunks)
+        {
+            if (!chunk.supported)
+                return false;
+
+            chunk.firstPosition = positionCount;
+            chunk.firstNormal = normalCount;
+            chunk.firstTexcoord = texcoordCount;
+            chunk.firstIndex = indexCount;
+
+            positionCount += chunk.positions.size() / 3;
+            normalCount += chunk.normals.size() / 3;
+            texcoordCount += chunk.texcoords.size() / 2;
+            for (uint8_t faceSize : chunk.faceSizes)
+            {
+                indexCount += faceSize == 4 ? 6 : 3;
+            }
+        }
+
+        attrib = tinyobj::attrib_t{};
+        attrib.vertices.resize(positionCount * 3);
+        attrib.colors.resize(positionCount * 3);
+        attrib.normals.resize(normalCount * 3);
+        attrib.texcoords.resize(texcoordCount * 2);
+        indices.resize(indexCount);
+
+        pool.parallelFor(chunks.size(), [&chunks, &attrib](size_t i)
+                         {
+                             const ObjChunk &chunk = chunks[i];
+                             copyInto(attrib.vertices, chunk.positions, chunk.firstPosition * 3);
+                             copyInto(attrib.colors, chunk.colors, chunk.firstPosition * 3);
+                             copyInto(attrib.normals, chunk.normals, chunk.firstNormal * 3);
+                             copyInto(attrib.texcoords, chunk.texcoords, chunk.firstTexcoord * 2); });
+
+        // quads need the merged positions to pick their diagonal, so faces are emitted in a second pass
+        std::atomic<bool> allValid{true};
+        pool.parallelFor(chunks.size(), [&chunks, &attrib, &indices, &allValid](size_t i)
+                         {
+                             const ObjChunk &chunk = chunks[i];
+                             const std::vector<float> &v = attrib.vertices;
+                             size_t corner = 0;
+                             size_t out = chunk.firstIndex;
+
+                             for (uint8_t faceSize : chunk.faceSizes)
+                             {
+                                 tinyobj::index_t face[4];
+                                 for (uint8_t k = 0; k < faceSize; k++)
+                                 {
+                                     if (!resolveCorner(chunk.corners[corner + k], chunk, attrib, face[k]))
+                                     {
+                                         allValid = false;
+                                         return;
+                                     }
+                                 }
+                                 corner += faceSize;
+
+                                 if (faceSize == 3)
+                                 {
+                                     indices[out++] = face[0];
+                                     indices[out++] = face[1];
+                                     indices[out++] = face[2];
+                                     continue;
+                                 }
+
+                                 // split along the shorter diagonal, same float math as tinyobj
+                                 const size_t vi0 = face[0].vertex_index, vi1 = face[1].vertex_index;
+                                 const size_t vi2 = face[2].vertex_index, vi3 = face[3].vertex_index;
+                                 float e02x = v[vi2 * 3 + 0] - v[vi0 * 3 + 0];
+                                 float e02y = v[vi2 * 3 + 1] - v[vi0 * 3 + 1];
+                                 float e02z = v[vi2 * 3 + 2] - v[vi0 * 3 + 2];
+                                 float e13x = v[vi3 * 3 + 0] - v[vi1 * 3 + 0];
+                                 float e13y = v[vi3 * 3 + 1] - v[vi1 * 3 + 1];
+                                 float e13z = v[vi3 * 3 + 2] - v[vi1 * 3 + 2];
+                                 float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+                                 float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+                                 if (sqr02 < sqr13)
+                                 {
+                                     indices[out++] = face[0];
+                                     indices[out++] = face[1];
+                                     indices[out++] = face[2];
+                                     indices[out++] = face[0];
+                                     indices[out++] = face[2];
+                                     indices[out++] = face[3];
+                                 }
+                                 else
+                                 {
+                                     indices[out++] = face[0];
+                                     indices[out++] = face[1];
+                                     indices[out++] = face[3];
+                                     indices[out++] = face[1];
+                                     indices[out++] = face[2];
+                                     indices[out++] = face[3];
+                                 }
+                             } });
+
+        return allValid;
+    }
+}
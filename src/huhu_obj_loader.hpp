@@ -0,0 +1,22 @@
+#pragma once
+
+// libs
+#include <tiny_obj_loader.h>
+
+// std
+#include <string>
+#include <vector>
+
+namespace huhu
+{
+    // Chunked, multithreaded reader for the part of OBJ our assets actually use: v/vn/vt records and triangle or quad
+    // faces. Produces exactly what tinyobj would (same float rounding, same quad split, faces in file order), so the
+    // result can be fed through the same vertex dedup as the tinyobj path.
+    class HuhuObjLoader
+    {
+    public:
+        // Returns false if the file needs something only tinyobj handles (n-gons, lone '\r' line endings, bad or
+        // out of range indices); the caller should fall back to tinyobj::LoadObj in that case.
+        static bool load(const std::string &filepath, tinyobj::attrib_t &attrib, std::vector<tinyobj::index_t> &indices);
+    };
+}
@@ -15,11 +15,22 @@ namespace huhu
         createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
     }
 
+    HuhuPipeline::HuhuPipeline(HuhuDevice &device, const std::string &compFilepath, VkPipelineLayout pipelineLayout)
+        : huhuDevice{device}, bindPoint{VK_PIPELINE_BIND_POINT_COMPUTE}
+    {
+        createComputePipeline(compFilepath, pipelineLayout);
+    }
+
     HuhuPipeline::~HuhuPipeline()
     {
-        vkDestroyShaderModule(huhuDevice.device(), vertShaderModule, nullptr);
-        vkDestroyShaderModule(huhuDevice.device(), fragShaderModule, nullptr);
-        vkDestroyPipeline(huhuDevice.device(), graphicsPipeline, nullptr);
+        huhuDevice.deletionQueue().defer(
+            [device = huhuDevice.device(), vertShaderModule = vertShaderModule, fragShaderModule = fragShaderModule, compShaderModule = compShaderModule, graphicsPipeline = graphicsPipeline]()
+            {
+                vkDestroyShaderModule(device, vertShaderModule, nullptr);
+                vkDestroyShaderModule(device, fragShaderModule, nullptr);
+                vkDestroyShaderModule(device, compShaderModule, nullptr);
+                vkDestroyPipeline(device, graphicsPipeline, nullptr);
+            });
     }
 
     std::vector<char> HuhuPipeline::readFile(const std::string &filepath)
@@ -105,6 +116,27 @@ namespace huhu
         }
     }
 
+    void HuhuPipeline::createComputePipeline(const std::string &compFilepath, VkPipelineLayout pipelineLayout)
+    {
+        assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline; no pipelineLayout provided!");
+
+        auto compCode = readFile(compFilepath);
+        createShaderModule(compCode, &compShaderModule);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = compShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+
+        if (vkCreateComputePipelines(huhuDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create compute pipeline");
+        }
+    }
+
     void HuhuPipeline::createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule)
     {
         VkShaderModuleCreateInfo createInfo{};
@@ -120,7 +152,7 @@ namespace huhu
 
     void HuhuPipeline::bind(VkCommandBuffer commandBuffer)
     {
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        vkCmdBindPipeline(commandBuffer, bindPoint, graphicsPipeline);
     }
 
     void HuhuPipeline::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo)
@@ -33,6 +33,8 @@ namespace huhu
     {
     public:
         HuhuPipeline(HuhuDevice &device, const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+        // compute pipeline
+        HuhuPipeline(HuhuDevice &device, const std::string &compFilepath, VkPipelineLayout pipelineLayout);
         ~HuhuPipeline();
 
         HuhuPipeline(const HuhuPipeline &) = delete;
@@ -46,12 +48,15 @@ namespace huhu
         static std::vector<char> readFile(const std::string &filepath);
 
         void createGraphicsPipeline(const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+        void createComputePipeline(const std::string &compFilepath, VkPipelineLayout pipelineLayout);
 
         void createShaderModule(const std::vector<char> &code, VkShaderModule *shaderModule);
 
         HuhuDevice &huhuDevice;
-        VkPipeline graphicsPipeline;
-        VkShaderModule vertShaderModule;
-        VkShaderModule fragShaderModule;
+        VkPipeline graphicsPipeline; // or the compute pipeline
+        VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        VkShaderModule vertShaderModule = VK_NULL_HANDLE;
+        VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+        VkShaderModule compShaderModule = VK_NULL_HANDLE;
     };
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace huhu
+{
+    // Stable LSD radix sort on a 64 bit key, one byte per pass. Passes where every key has the same byte are skipped,
+    // so keys that only use some of their bits only pay for those. scratch needs room for count items, frame arena
+    // memory is fine. Returns items or scratch, whichever ended up with the sorted order.
+    template <typename T, typename KeyFn>
+    T *radixSort64(T *items, T *scratch, uint32_t count, KeyFn key)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "items are moved around with plain copies");
+        if (count < 2)
+            return items;
+
+        // all eight histograms in a single read of the keys
+        uint32_t histograms[8][256] = {};
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint64_t k = key(items[i]);
+            for (int byte = 0; byte < 8; byte++)
+            {
+                histograms[byte][(k >> (byte * 8)) & 0xff]++;
+            }
+        }
+
+        T *source = items;
+        T *destination = scratch;
+        for (int byte = 0; byte < 8; byte++)
+        {
+            const int shift = byte * 8;
+            const uint32_t *histogram = histograms[byte];
+            if (histogram[(key(source[0]) >> shift) & 0xff] == count)
+                continue; // every key has the same byte here
+
+            uint32_t offsets[256];
+            uint32_t sum = 0;
+            for (int digit = 0; digit < 256; digit++)
+            {
+                offsets[digit] = sum;
+                sum += histogram[digit];
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                destination[offsets[(key(source[i]) >> shift) & 0xff]++] = source[i];
+            }
+            std::swap(source, destination);
+        }
+        return source;
+    }
+}
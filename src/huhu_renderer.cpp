@@ -23,7 +23,6 @@ namespace huhu
             extent = huhuWindow.getExtent();
             glfwWaitEvents();
         }
-        vkDeviceWaitIdle(huhuDevice.device());
 
         if (huhuSwapChain == nullptr)
         {
@@ -38,6 +37,9 @@ namespace huhu
             {
                 throw std::runtime_error("Swap chain image or depth format has changed!");
             }
+
+            // its framebuffers, depth image and swap chain images may still be in use by frames in flight
+            huhuDevice.deletionQueue().defer([oldSwapChain]() {});
         }
 
         // we'll be back
@@ -86,6 +88,9 @@ namespace huhu
         }
 
         isFrameStarted = true;
+        // the frame's fence has signaled in acquireNextImage, nothing of the last use of this slot is alive anymore
+        frameArenas[currentFrameIndex].reset();
+        huhuDevice.deletionQueue().beginFrame();
 
         auto commandBuffer = getCurrentCommandBuffer();
         VkCommandBufferBeginInfo beginInfo{};
@@ -108,6 +113,12 @@ namespace huhu
             throw std::runtime_error("failed to record command buffer!");
         }
 
+        // everything written to non coherent memory this frame, in one go
+        if (huhuDevice.flushDirtyRanges() != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to flush mapped memory!");
+        }
+
         auto result = huhuSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
             huhuWindow.wasWindowResized())
@@ -4,8 +4,10 @@
 #include "huhu_window.hpp"
 #include "huhu_device.hpp"
 #include "huhu_swap_chain.hpp"
+#include "huhu_frame_arena.hpp"
 
 // std
+#include <array>
 #include <memory>
 #include <vector>
 #include <cassert>
@@ -37,6 +39,13 @@ namespace huhu
             return currentFrameIndex;
         }
 
+        // reset at beginFrame, so anything from it is gone by the time the frame slot comes around again
+        HuhuFrameArena &getFrameArena()
+        {
+            assert(isFrameStarted && "Cannot get frame arena when frame is not in progress!");
+            return frameArenas[currentFrameIndex];
+        }
+
         VkCommandBuffer beginFrame();
         void endFrame();
         void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
@@ -51,6 +60,7 @@ namespace huhu
         HuhuDevice &huhuDevice;
         std::unique_ptr<HuhuSwapChain> huhuSwapChain;
         std::vector<VkCommandBuffer> commandBuffers;
+        std::array<HuhuFrameArena, HuhuSwapChain::MAX_FRAMES_IN_FLIGHT> frameArenas;
 
         uint32_t currentImageIndex;
         int currentFrameIndex = 0;
@@ -0,0 +1,120 @@
+#include "huhu_staging_ring.hpp"
+
+#include "huhu_device.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace huhu
+{
+    HuhuStagingRing::HuhuStagingRing(HuhuDevice &device, VkDeviceSize size) : huhuDevice{device}, size{size}
+    {
+        // concurrent sharing, blocking uploads copy out of it on the graphics queue and streamed ones on transfer
+        huhuDevice.createBuffer(
+            size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            buffer,
+            memory,
+            true);
+    }
+
+    HuhuStagingRing::~HuhuStagingRing()
+    {
+        for (const auto &submission : inFlight)
+        {
+            vkWaitForFences(huhuDevice.device(), 1, &submission.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(huhuDevice.device(), submission.fence, nullptr);
+        }
+        for (VkFence fence : freeFences)
+        {
+            vkDestroyFence(huhuDevice.device(), fence, nullptr);
+        }
+        vkDestroyBuffer(huhuDevice.device(), buffer, nullptr);
+        huhuDevice.freeMemory(memory);
+    }
+
+    bool HuhuStagingRing::allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, StagingRegion &region)
+    {
+        assert(allocationSize <= size && "allocation doesn't fit the staging ring, chunk it");
+
+        VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+        if (start % size + allocationSize > size)
+        {
+            start = (start / size + 1) * size; // doesn't fit before the end, skip to the front
+        }
+
+        if (start + allocationSize - tail > size)
+        {
+            reclaim();
+            if (start + allocationSize - tail > size)
+                return false;
+        }
+
+        head = start + allocationSize;
+        region.offset = start % size;
+        region.size = allocationSize;
+        region.mapped = static_cast<char *>(memory.mapped) + region.offset;
+        return true;
+    }
+
+    HuhuStagingRing::Submission HuhuStagingRing::endSubmission()
+    {
+        VkFence fence;
+        if (!freeFences.empty())
+        {
+            fence = freeFences.back();
+            freeFences.pop_back();
+        }
+        else
+        {
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(huhuDevice.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create staging fence!");
+            }
+        }
+
+        inFlight.push_back({nextTicket, fence, head});
+        return {nextTicket++, fence};
+    }
+
+    bool HuhuStagingRing::isComplete(uint64_t ticket)
+    {
+        if (ticket > completedTicket)
+            reclaim();
+        return ticket <= completedTicket;
+    }
+
+    void HuhuStagingRing::wait(uint64_t ticket)
+    {
+        while (ticket > completedTicket)
+        {
+            assert(!inFlight.empty() && "waiting for a ticket that was never handed out");
+            vkWaitForFences(huhuDevice.device(), 1, &inFlight.front().fence, VK_TRUE, UINT64_MAX);
+            reclaim();
+        }
+    }
+
+    void HuhuStagingRing::waitOldest()
+    {
+        assert(!inFlight.empty() && "nothing in flight, the allocation would never fit");
+        wait(inFlight.front().ticket);
+    }
+
+    void HuhuStagingRing::reclaim()
+    {
+        // strictly in order, so a finished submission behind an unfinished one waits for it
+        while (!inFlight.empty() && vkGetFenceStatus(huhuDevice.device(), inFlight.front().fence) == VK_SUCCESS)
+        {
+            const InFlight &submission = inFlight.front();
+            vkResetFences(huhuDevice.device(), 1, &submission.fence);
+            freeFences.push_back(submission.fence);
+            tail = submission.end;
+            completedTicket = submission.ticket;
+            inFlight.pop_front();
+        }
+    }
+}
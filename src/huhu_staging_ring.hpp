@@ -0,0 +1,86 @@
+#pragma once
+
+#include "huhu_memory_allocator.hpp"
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace huhu
+{
+    class HuhuDevice;
+
+    // A range of the staging ring, already mapped.
+    struct StagingRegion
+    {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void *mapped = nullptr;
+    };
+
+    // One persistently mapped host visible buffer that every upload stages through, instead of creating, mapping and
+    // destroying a staging buffer per upload. Space is handed out front to back. Each queue submission that reads
+    // from the ring closes the space allocated since the previous one with a fence owned by the ring, and that space
+    // is reclaimed once the fence signals. Submissions are identified by increasing tickets, which makes it easy to
+    // wait for a particular one from anywhere. Space has to be submitted before anybody else ends a submission, or
+    // it'd be handed back with theirs. Not thread safe, it's used from the render thread only.
+    class HuhuStagingRing
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_SIZE = 32ull * 1024 * 1024;
+
+        struct Submission
+        {
+            uint64_t ticket;
+            VkFence fence; // signal this from the vkQueueSubmit that runs the copies
+        };
+
+        HuhuStagingRing(HuhuDevice &device, VkDeviceSize size = DEFAULT_SIZE);
+        ~HuhuStagingRing();
+
+        HuhuStagingRing(const HuhuStagingRing &) = delete;
+        HuhuStagingRing &operator=(const HuhuStagingRing &) = delete;
+
+        VkBuffer getBuffer() const { return buffer; }
+        // bigger uploads get staged in pieces of at most this, so a few of them can be in flight at once
+        VkDeviceSize getMaxChunkSize() const { return size / 4; }
+
+        // returns false if the space isn't free yet, submit what's staged and try again later
+        bool allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, StagingRegion &region);
+        // everything allocated since the last call gets reclaimed once the returned fence signals
+        Submission endSubmission();
+
+        bool isComplete(uint64_t ticket);
+        void wait(uint64_t ticket);
+        // for when allocate() keeps failing, blocks until the oldest submission has freed its space
+        void waitOldest();
+
+    private:
+        struct InFlight
+        {
+            uint64_t ticket;
+            VkFence fence;
+            VkDeviceSize end;
+        };
+
+        void reclaim();
+
+        HuhuDevice &huhuDevice;
+        VkDeviceSize size;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory{};
+
+        // positions only ever grow, the offset in the buffer is position % size
+        VkDeviceSize head = 0;
+        VkDeviceSize tail = 0;
+
+        uint64_t nextTicket = 1;
+        uint64_t completedTicket = 0; // every ticket up to this one is done
+        std::deque<InFlight> inFlight{};
+        std::vector<VkFence> freeFences{};
+    };
+}
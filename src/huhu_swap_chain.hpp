@@ -71,9 +71,10 @@ namespace huhu
         std::vector<VkFramebuffer> swapChainFramebuffers;
         VkRenderPass renderPass;
 
-        std::vector<VkImage> depthImages;
-        std::vector<VkDeviceMemory> depthImageMemorys;
-        std::vector<VkImageView> depthImageViews;
+        // one for all frames, depth is cleared on load and never stored so nothing carries over between them
+        VkImage depthImage;
+        MemoryAllocation depthImageMemory;
+        VkImageView depthImageView;
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
 
@@ -0,0 +1,115 @@
+#include "huhu_thread_pool.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+
+namespace huhu
+{
+    HuhuThreadPool::HuhuThreadPool(uint32_t threadCount)
+    {
+        threadCount = std::max(threadCount, 1u); // hardware_concurrency is allowed to return 0
+        workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back([this]()
+                                 { workerLoop(); });
+        }
+    }
+
+    HuhuThreadPool::~HuhuThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{tasksMutex};
+            stopping = true;
+        }
+        tasksAvailable.notify_all();
+
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    HuhuThreadPool &HuhuThreadPool::shared()
+    {
+        static HuhuThreadPool pool{};
+        return pool;
+    }
+
+    void HuhuThreadPool::enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock{tasksMutex};
+            tasks.push_back(std::move(task));
+        }
+        tasksAvailable.notify_one();
+    }
+
+    void HuhuThreadPool::workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock{tasksMutex};
+                tasksAvailable.wait(lock, [this]()
+                                    { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void HuhuThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1)
+        {
+            body(0);
+            return;
+        }
+
+        // Shared so helpers that only get scheduled after we returned still find valid state. We wait on finished
+        // items instead of on the helpers themselves, that way nested calls can't deadlock on a busy pool.
+        struct LoopState
+        {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> finished{0};
+            std::mutex doneMutex;
+            std::condition_variable done;
+        };
+        auto state = std::make_shared<LoopState>();
+
+        auto runItems = [state, count, &body]()
+        {
+            size_t index;
+            while ((index = state->next.fetch_add(1)) < count)
+            {
+                body(index);
+                if (state->finished.fetch_add(1) + 1 == count)
+                {
+                    std::lock_guard<std::mutex> lock{state->doneMutex};
+                    state->done.notify_all();
+                }
+            }
+        };
+
+        const size_t helperCount = std::min<size_t>(count - 1, workers.size());
+        for (size_t i = 0; i < helperCount; i++)
+        {
+            // body is only dereferenced while items are left, which can't outlive this call
+            enqueue(runItems);
+        }
+        runItems();
+
+        std::unique_lock<std::mutex> lock{state->doneMutex};
+        state->done.wait(lock, [&state, count]()
+                         { return state->finished.load() == count; });
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace huhu
+{
+    class HuhuThreadPool
+    {
+    public:
+        HuhuThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+        ~HuhuThreadPool();
+
+        HuhuThreadPool(const HuhuThreadPool &) = delete;
+        HuhuThreadPool &operator=(const HuhuThreadPool &) = delete;
+
+        // pool shared by everything that just wants some cores, created on first use
+        static HuhuThreadPool &shared();
+
+        template <typename Task>
+        auto submit(Task &&task) -> std::future<std::invoke_result_t<Task>>
+        {
+            // packaged_task is move-only, std::function wants something copyable
+            auto packagedTask = std::make_shared<std::packaged_task<std::invoke_result_t<Task>()>>(std::forward<Task>(task));
+            auto future = packagedTask->get_future();
+            enqueue([packagedTask]()
+                    { (*packagedTask)(); });
+            return future;
+        }
+
+        // Runs body(i) for every i in [0, count) and blocks until all are done. The calling thread helps out,
+        // so this is safe to call from inside a pool task as well.
+        void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+        uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    private:
+        void enqueue(std::function<void()> task);
+        void workerLoop();
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex tasksMutex;
+        std::condition_variable tasksAvailable;
+        bool stopping = false;
+    };
+}
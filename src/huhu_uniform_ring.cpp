@@ -0,0 +1,57 @@
+#include "huhu_uniform_ring.hpp"
+
+#include "huhu_swap_chain.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace huhu
+{
+    HuhuUniformRing::HuhuUniformRing(HuhuDevice &device, VkDeviceSize frameSize)
+        : alignment{std::max<VkDeviceSize>(device.properties.limits.minUniformBufferOffsetAlignment, 1)}
+    {
+        // whole aligned regions, so every frame starts out aligned
+        this->frameSize = (frameSize + alignment - 1) / alignment * alignment;
+        buffer = std::make_unique<HuhuBuffer>(
+            device,
+            this->frameSize,
+            HuhuSwapChain::MAX_FRAMES_IN_FLIGHT,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        buffer->map();
+    }
+
+    void HuhuUniformRing::beginFrame(int frameIndex)
+    {
+        frameBegin = frameIndex * frameSize;
+        frameUsed = 0;
+    }
+
+    UniformAllocation HuhuUniformRing::allocate(VkDeviceSize size)
+    {
+        const VkDeviceSize offset = frameBegin + frameUsed;
+        const VkDeviceSize alignedSize = (size + alignment - 1) / alignment * alignment;
+        if (frameUsed + alignedSize > frameSize)
+        {
+            throw std::runtime_error("uniform ring is out of space for this frame!");
+        }
+        frameUsed += alignedSize;
+
+        return {static_cast<uint32_t>(offset), static_cast<char *>(buffer->getMappedMemory()) + offset};
+    }
+
+    uint32_t HuhuUniformRing::push(const void *data, VkDeviceSize size)
+    {
+        UniformAllocation allocation = allocate(size);
+        memcpy(allocation.mapped, data, size);
+        return allocation.offset;
+    }
+
+    void HuhuUniformRing::flush()
+    {
+        if (frameUsed > 0)
+            buffer->markDirty(frameUsed, frameBegin);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "huhu_buffer.hpp"
+#include "huhu_device.hpp"
+
+// std
+#include <cstdint>
+#include <memory>
+
+namespace huhu
+{
+    // Space in the uniform ring, offset is what goes into vkCmdBindDescriptorSets as the dynamic offset.
+    struct UniformAllocation
+    {
+        uint32_t offset;
+        void *mapped;
+    };
+
+    // Persistently mapped uniform buffer for transient per frame data. Every frame in flight owns one region that
+    // systems bump allocate from, aligned to minUniformBufferOffsetAlignment, and that starts over once the frame's
+    // fence has signaled. Bind it as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC and pass the allocation's offset when
+    // binding, so a single descriptor set serves every frame and every allocation.
+    class HuhuUniformRing
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 1024 * 1024;
+
+        HuhuUniformRing(HuhuDevice &device, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+
+        HuhuUniformRing(const HuhuUniformRing &) = delete;
+        HuhuUniformRing &operator=(const HuhuUniformRing &) = delete;
+
+        // call once the frame's fence has signaled, i.e. after HuhuRenderer::beginFrame
+        void beginFrame(int frameIndex);
+        UniformAllocation allocate(VkDeviceSize size);
+        // copies data into a fresh allocation, returns the dynamic offset
+        uint32_t push(const void *data, VkDeviceSize size);
+        // queues this frame's writes for the batched flush in HuhuRenderer::endFrame, one range for the whole frame
+        void flush();
+
+        // range is the size of the struct the binding is read as, it's fixed for dynamic descriptors
+        VkDescriptorBufferInfo descriptorInfo(VkDeviceSize range) { return buffer->descriptorInfo(range, 0); }
+
+    private:
+        std::unique_ptr<HuhuBuffer> buffer;
+        VkDeviceSize frameSize;
+        VkDeviceSize alignment;
+
+        VkDeviceSize frameBegin = 0;
+        VkDeviceSize frameUsed = 0;
+    };
+}
@@ -0,0 +1,149 @@
+#include "huhu_upload_batch.hpp"
+
+#include "huhu_staging_ring.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace huhu
+{
+    HuhuUploadBatch::HuhuUploadBatch(HuhuDevice &device) : huhuDevice{device}
+    {
+        // a pool of our own, so the command buffers can all go at once when the batch is done
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = huhuDevice.findPhysicalQueueFamilies().graphicsFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        if (vkCreateCommandPool(huhuDevice.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+    }
+
+    HuhuUploadBatch::~HuhuUploadBatch()
+    {
+        submit(); // anything still recording would be lost otherwise
+        wait();
+        vkDestroyCommandPool(huhuDevice.device(), commandPool, nullptr);
+    }
+
+    void HuhuUploadBatch::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(getCommandBuffer(), srcBuffer, dstBuffer, 1, &copyRegion);
+    }
+
+    void HuhuUploadBatch::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount)
+    {
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = layerCount;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {width, height, 1};
+
+        vkCmdCopyBufferToImage(
+            getCommandBuffer(),
+            buffer,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &region);
+    }
+
+    void HuhuUploadBatch::write(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+    {
+        HuhuStagingRing &ring = huhuDevice.stagingRing();
+        VkDeviceSize written = 0;
+        while (written < size)
+        {
+            const VkDeviceSize chunkSize = std::min(size - written, ring.getMaxChunkSize());
+            StagingRegion region{};
+            if (!ring.allocate(chunkSize, 16, region))
+            {
+                // our own earlier pieces might be what's filling the ring, so they have to go out first
+                flush();
+                ring.waitOldest();
+                continue;
+            }
+
+            memcpy(region.mapped, static_cast<const char *>(data) + written, chunkSize);
+            copyBuffer(ring.getBuffer(), dstBuffer, chunkSize, region.offset, dstOffset + written);
+            written += chunkSize;
+        }
+    }
+
+    void HuhuUploadBatch::flush()
+    {
+        if (commandBuffer == VK_NULL_HANDLE)
+            return;
+
+        // later work on the graphics queue sees the copies without further syncing
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0,
+            1, &barrier,
+            0, nullptr,
+            0, nullptr);
+        vkEndCommandBuffer(commandBuffer);
+
+        // the ring's fence covers both the staged data and the command buffer
+        const HuhuStagingRing::Submission submission = huhuDevice.stagingRing().endSubmission();
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(huhuDevice.graphicsQueue(), 1, &submitInfo, submission.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload batch!");
+        }
+
+        token.ticket = submission.ticket;
+        commandBuffer = VK_NULL_HANDLE;
+    }
+
+    UploadToken HuhuUploadBatch::submit()
+    {
+        flush();
+        return token;
+    }
+
+    VkCommandBuffer HuhuUploadBatch::getCommandBuffer()
+    {
+        if (commandBuffer != VK_NULL_HANDLE)
+            return commandBuffer;
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(huhuDevice.device(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+}
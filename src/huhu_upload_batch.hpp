@@ -0,0 +1,47 @@
+#pragma once
+
+#include "huhu_device.hpp"
+
+// std
+#include <cstdint>
+
+namespace huhu
+{
+    // Records many copies into one command buffer and submits them on the graphics queue with a single fence,
+    // instead of a submit and a full queue drain per copy like the single time commands do. Data written through the
+    // batch is staged in the device's staging ring. When the ring runs full the batch submits what it has so far and
+    // carries on once there's room, so any amount of data fits. Submit before anything else uses the ring again, its
+    // space is handed back in allocation order. Keep the batch alive until its token completes, destroying it earlier
+    // waits. Render thread only, like the ring.
+    class HuhuUploadBatch
+    {
+    public:
+        HuhuUploadBatch(HuhuDevice &device);
+        ~HuhuUploadBatch();
+
+        HuhuUploadBatch(const HuhuUploadBatch &) = delete;
+        HuhuUploadBatch &operator=(const HuhuUploadBatch &) = delete;
+
+        void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+        void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+        // stages data through the ring, in pieces if it's big
+        void write(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+
+        // Submits what's recorded so far and starts a fresh command buffer. Only needed to make room in the ring when
+        // staging by hand.
+        void flush();
+        // flushes and returns the token for everything recorded into the batch
+        UploadToken submit();
+
+        bool isComplete() { return huhuDevice.isUploadComplete(token); }
+        void wait() { huhuDevice.waitForUpload(token); }
+
+    private:
+        VkCommandBuffer getCommandBuffer();
+
+        HuhuDevice &huhuDevice;
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE; // recording, null until the first copy
+        UploadToken token{};
+    };
+}
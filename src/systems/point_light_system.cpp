@@ -106,8 +106,8 @@ namespace huhu
             0, // first set
             1, // set count
             &frameInfo.globalDescriptorSet,
-            0,      // dynamic offset count
-            nullptr // dynamic offsets data
+            1,                         // dynamic offset count
+            &frameInfo.globalUboOffset // dynamic offsets data
         );
 
         for (auto &kv : frameInfo.gameObjects)
@@ -1,5 +1,9 @@
 #include "simple_render_system.hpp"
 
+#include "huhu_frustum_culling.hpp"
+#include "huhu_radix_sort.hpp"
+#include "huhu_swap_chain.hpp"
+
 // libs
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -7,41 +11,290 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 
 namespace huhu
 {
-    struct SimplePushConstantData
+    // one per drawn object, std430 layout of Instance in the vertex shaders
+    struct InstanceData
     {
         glm::mat4 modelMatrix{1.f};
         glm::mat4 normalMatrix{1.f};
     };
 
+    // an object to draw this frame, sorted so objects sharing a model and level end up next to each other
+    struct DrawItem
+    {
+        HuhuModel *model;
+        HuhuGameObject *object;
+        uint32_t lod;
+        uint32_t instance; // into the unsorted instance data
+        float maxScale;
+        uint64_t sortKey;
+    };
+
+    // models in a batch share pipeline and buffers, so their commands go out with a single indirect draw
+    struct DrawBatch
+    {
+        HuhuModel *model; // the first one, for binding
+        uint32_t firstCommand;
+        uint32_t commandCount;
+        // models without an index buffer are drawn directly, they are a batch of their own
+        uint32_t lod;
+        uint32_t instanceCount;
+        uint32_t firstInstance;
+    };
+
+    // one per instance for the cull pass, std430 layout of CullObject in cull.comp
+    struct CullObject
+    {
+        glm::vec4 sphere; // model space center, radius already in world units
+        uint32_t firstCommand;
+        uint32_t commandCount; // every command of the draw the instance belongs to, 0 to leave it alone
+        uint32_t firstInstance;
+        uint32_t padding;
+    };
+
+    struct CullPushConstants
+    {
+        glm::vec4 frustumPlanes[6];
+        uint32_t objectCount;
+    };
+
+    // cull.comp reads these with std430 rules, nothing checks that at runtime
+    static_assert(sizeof(CullObject) == 32 && offsetof(CullObject, firstCommand) == 16, "CullObject has to match cull.comp");
+    static_assert(offsetof(CullPushConstants, objectCount) == 96, "CullPushConstants has to match cull.comp");
+    static_assert(sizeof(VkDrawIndexedIndirectCommand) == 20, "cull.comp indexes the draw commands with a 20 byte stride");
+
+    // how many draws from first on share its model and level, they go out as one instanced draw
+    static uint32_t runLength(const DrawItem *draws, uint32_t first, uint32_t count)
+    {
+        uint32_t length = 1;
+        while (first + length < count && draws[first + length].model == draws[first].model && draws[first + length].lod == draws[first].lod)
+            length++;
+        return length;
+    }
+
+    // Meshlets only exist for the full detail level, coarser levels are cheap enough to draw whole. A model drawn many
+    // times is better off instanced whole, meshlet culling is for the one big object.
+    static bool drawsMeshlets(const DrawItem &draw, uint32_t instanceCount)
+    {
+        return instanceCount == 1 && draw.lod == 0 && !draw.model->getMeshlets().empty();
+    }
+
+    // fibonacci hashing, spreads handles and pointers over the few bits a sort key has for them
+    static uint64_t hashBits(uint64_t value, int bits)
+    {
+        return (value * 0x9e3779b97f4a7c15ull) >> (64 - bits);
+    }
+
+    // Sort key of a draw, most significant first:
+    //   pass 2 bits | pipeline 2 | vertex buffer 12 | model 16 | lod 4 | depth 20 | unused 8
+    // Everything that needs a rebind comes first and runs of a model and level stay together for instancing. Depth
+    // goes last and orders the instances of every run front to back, so early depth testing can skip covered fragments.
+    // Hash collisions only cost extra binds or split an instanced run, the draws are still right.
+    static uint64_t makeSortKey(const HuhuModel &model, uint32_t lod, float viewDepth)
+    {
+        constexpr uint64_t OPAQUE_PASS = 0; // everything is opaque for now
+        const uint64_t pipeline = static_cast<uint64_t>(model.getVertexFormat()) & 0x3;
+        const uint64_t vertexBuffer = hashBits(reinterpret_cast<uint64_t>(model.getVertexBuffer()), 12);
+        const uint64_t modelBits = hashBits(reinterpret_cast<uint64_t>(&model), 16);
+        const uint64_t lodBits = std::min(lod, 15u);
+
+        // positive floats sort like their bits, the top ones are the exponent and the start of the mantissa
+        const float depth = std::max(viewDepth, 0.f);
+        uint32_t depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        const uint64_t depthKey = (depthBits >> 11) & 0xfffff;
+
+        return OPAQUE_PASS << 62 | pipeline << 60 | vertexBuffer << 48 | modelBits << 32 | lodBits << 28 | depthKey << 8;
+    }
+
+    // Growing replaces the buffer, the old one goes through the deletion queue as frames in flight may still read it.
+    // Returns whether it was replaced.
+    static bool reserveBuffer(HuhuDevice &device, std::unique_ptr<HuhuBuffer> &buffer, VkDeviceSize elementSize, uint32_t count, VkBufferUsageFlags usage)
+    {
+        if (buffer->getInstanceCount() >= count)
+            return false;
+
+        uint32_t capacity = buffer->getInstanceCount();
+        while (capacity < count)
+            capacity *= 2;
+
+        buffer = std::make_unique<HuhuBuffer>(device, elementSize, capacity, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        buffer->map();
+        return true;
+    }
+
+    // largest simplification error we accept on screen, as a fraction of its height (about a pixel at 1080p)
+    constexpr float LOD_SCREEN_ERROR = 1.f / 1080.f;
+
+    // How much of the screen height one model space unit covers at the object. Uses the near side of the bounding
+    // sphere so objects we are standing in always get full detail.
+    static float projectedUnitsToScreen(const HuhuCamera &camera, const glm::mat4 &modelMatrix, const HuhuModel::BoundingBox &bounds, float maxScale)
+    {
+        const glm::mat4 &projection = camera.getProjection();
+        float unitsToScreen = std::abs(projection[1][1]) * .5f * maxScale; // ndc spans 2 units of screen height
+
+        if (projection[2][3] != 0.f) // perspective, things shrink with depth
+        {
+            const glm::vec3 center = (bounds.min + bounds.max) * .5f;
+            const float radius = glm::length(bounds.max - bounds.min) * .5f * maxScale;
+            const float depth = (camera.getView() * (modelMatrix * glm::vec4{center, 1.f})).z - radius;
+            if (depth <= 0.f)
+                return std::numeric_limits<float>::max();
+            unitsToScreen /= depth;
+        }
+        return unitsToScreen;
+    }
+
+    static bool sphereInFrustum(const std::array<glm::vec4, 6> &planes, const glm::vec3 &center, float radius)
+    {
+        for (const auto &plane : planes)
+        {
+            if (glm::dot(glm::vec3{plane}, center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+
     SimpleRenderSystem::SimpleRenderSystem(HuhuDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : huhuDevice{device}
     {
+        createFrameResources();
         createPipelineLayout(globalSetLayout);
+
+        indirectDrawingSupported = device.enabledFeatures.multiDrawIndirect && device.enabledFeatures.drawIndirectFirstInstance;
+        indirectDrawing = indirectDrawingSupported;
         createPipeline(renderPass);
+        if (indirectDrawingSupported)
+            createCullPipeline();
     }
 
-    SimpleRenderSystem::~SimpleRenderSystem() { vkDestroyPipelineLayout(huhuDevice.device(), pipelineLayout, nullptr); }
+    SimpleRenderSystem::~SimpleRenderSystem()
+    {
+        vkDestroyPipelineLayout(huhuDevice.device(), pipelineLayout, nullptr);
+        if (cullPipelineLayout != VK_NULL_HANDLE)
+            vkDestroyPipelineLayout(huhuDevice.device(), cullPipelineLayout, nullptr);
+    }
 
-    void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+    void SimpleRenderSystem::createFrameResources()
     {
-        VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(SimplePushConstantData);
+        instanceSetLayout = HuhuDescriptorSetLayout::Builder(huhuDevice)
+                                .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                                .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                                .build();
+        cullSetLayout = HuhuDescriptorSetLayout::Builder(huhuDevice)
+                            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+                            .build();
+        descriptorPool = HuhuDescriptorPool::Builder(huhuDevice)
+                             .setMaxSets(2 * HuhuSwapChain::MAX_FRAMES_IN_FLIGHT)
+                             .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * HuhuSwapChain::MAX_FRAMES_IN_FLIGHT)
+                             .build();
+
+        frames.resize(HuhuSwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto &frame : frames)
+        {
+            frame.instances = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                sizeof(InstanceData),
+                INITIAL_INSTANCE_CAPACITY,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.instances->map();
+
+            frame.visibleInstances = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                sizeof(uint32_t),
+                INITIAL_INSTANCE_CAPACITY,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.visibleInstances->map();
 
-        std::vector<VkDescriptorSetLayout> descriptorSetLayout{globalSetLayout};
+            frame.cullObjects = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                sizeof(CullObject),
+                INITIAL_INSTANCE_CAPACITY,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.cullObjects->map();
+
+            frame.drawCommands = std::make_unique<HuhuBuffer>(
+                huhuDevice,
+                sizeof(VkDrawIndexedIndirectCommand),
+                INITIAL_DRAW_COMMAND_CAPACITY,
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.drawCommands->map();
+
+            writeDescriptorSets(frame, false);
+        }
+    }
+
+    void SimpleRenderSystem::reserveFrameResources(int frameIndex, uint32_t instanceCount, uint32_t commandCount)
+    {
+        FrameResources &frame = frames[frameIndex];
+        bool replaced = reserveBuffer(huhuDevice, frame.instances, sizeof(InstanceData), instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        replaced |= reserveBuffer(huhuDevice, frame.visibleInstances, sizeof(uint32_t), instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        replaced |= reserveBuffer(huhuDevice, frame.cullObjects, sizeof(CullObject), instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        replaced |= reserveBuffer(
+            huhuDevice,
+            frame.drawCommands,
+            sizeof(VkDrawIndexedIndirectCommand),
+            commandCount,
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        // this frame's sets aren't in use anymore once the frame has begun, they can be pointed at the new buffers
+        if (replaced)
+            writeDescriptorSets(frame, true);
+    }
+
+    void SimpleRenderSystem::writeDescriptorSets(FrameResources &frame, bool overwrite)
+    {
+        auto instanceInfo = frame.instances->descriptorInfo();
+        auto visibleInfo = frame.visibleInstances->descriptorInfo();
+        auto cullObjectInfo = frame.cullObjects->descriptorInfo();
+        auto commandInfo = frame.drawCommands->descriptorInfo();
+
+        HuhuDescriptorWriter instanceWriter{*instanceSetLayout, *descriptorPool};
+        instanceWriter.writeBuffer(0, &instanceInfo).writeBuffer(1, &visibleInfo);
+        HuhuDescriptorWriter cullWriter{*cullSetLayout, *descriptorPool};
+        cullWriter.writeBuffer(0, &instanceInfo)
+            .writeBuffer(1, &cullObjectInfo)
+            .writeBuffer(2, &commandInfo)
+            .writeBuffer(3, &visibleInfo);
+
+        if (overwrite)
+        {
+            instanceWriter.overwrite(frame.instanceSet);
+            cullWriter.overwrite(frame.cullSet);
+        }
+        else
+        {
+            instanceWriter.build(frame.instanceSet);
+            cullWriter.build(frame.cullSet);
+        }
+    }
+
+    void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout)
+    {
+        std::vector<VkDescriptorSetLayout> descriptorSetLayout{globalSetLayout, instanceSetLayout->getDescriptorSetLayout()};
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
         pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
         if (vkCreatePipelineLayout(huhuDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
             VK_SUCCESS)
         {
@@ -57,48 +310,409 @@ namespace huhu
         HuhuPipeline::defaultPipelineConfigInfo(pipelineConfig);
         pipelineConfig.renderPass = renderPass;
         pipelineConfig.pipelineLayout = pipelineLayout;
+        backfaceCulling = pipelineConfig.rasterizationInfo.cullMode != VK_CULL_MODE_NONE;
         huhuPipeline = std::make_unique<HuhuPipeline>(
             huhuDevice,
             "shaders/simple_shader.vert.spv",
             "shaders/simple_shader.frag.spv",
             pipelineConfig);
+
+        PipelineConfigInfo packedPipelineConfig{};
+        HuhuPipeline::defaultPipelineConfigInfo(packedPipelineConfig);
+        packedPipelineConfig.bindingDescriptions = HuhuModel::PackedVertex::getBindingDescriptions();
+        packedPipelineConfig.attributeDescriptions = HuhuModel::PackedVertex::getAttributeDescriptions();
+        packedPipelineConfig.renderPass = renderPass;
+        packedPipelineConfig.pipelineLayout = pipelineLayout;
+        packedPipeline = std::make_unique<HuhuPipeline>(
+            huhuDevice,
+            "shaders/simple_shader_packed.vert.spv",
+            "shaders/simple_shader.frag.spv",
+            packedPipelineConfig);
+    }
+
+    void SimpleRenderSystem::createCullPipeline()
+    {
+        VkDescriptorSetLayout cullLayout = cullSetLayout->getDescriptorSetLayout();
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(CullPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &cullLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(huhuDevice.device(), &pipelineLayoutInfo, nullptr, &cullPipelineLayout) !=
+            VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create cull pipeline layout!");
+        }
+
+        cullPipeline = std::make_unique<HuhuPipeline>(huhuDevice, "shaders/cull.comp.spv", cullPipelineLayout);
+    }
+
+    void SimpleRenderSystem::prepare(FrameInfo &frameInfo)
+    {
+        const HuhuCamera &camera = frameInfo.camera;
+        frustumPlanes = camera.getFrustumPlanes();
+        prepared = true;
+        drawCount = 0;
+        batches = nullptr;
+        batchCount = 0;
+        commandCount = 0;
+
+        // gather everything with a model, lists are scratch from the frame arena
+        HuhuFrameArena &arena = frameInfo.frameArena;
+        const uint32_t maxDraws = static_cast<uint32_t>(frameInfo.gameObjects.size());
+        HuhuGameObject **objects = arena.allocate<HuhuGameObject *>(maxDraws);
+        float *maxScales = arena.allocate<float>(maxDraws);
+        InstanceData *instances = arena.allocate<InstanceData>(maxDraws);
+        BoundingSpheresSoA spheres{
+            arena.allocate<float>(maxDraws),
+            arena.allocate<float>(maxDraws),
+            arena.allocate<float>(maxDraws),
+            arena.allocate<float>(maxDraws),
+            0};
+
+        for (auto &kv : frameInfo.gameObjects)
+        {
+            auto &obj = kv.second;
+            if (obj.model == nullptr)
+                continue; // we dont need to do model stuff with obj without models; iterating like this is still inefficient 
+
+            const uint32_t i = spheres.count++;
+            const glm::vec3 &scale = obj.transform.scale;
+            objects[i] = &obj;
+            maxScales[i] = std::max(std::abs(scale.x), std::max(std::abs(scale.y), std::abs(scale.z)));
+            instances[i].modelMatrix = obj.transform.mat4();
+
+            const HuhuModel::BoundingBox &bounds = obj.model->getBounds();
+            const glm::vec3 center{instances[i].modelMatrix * glm::vec4{(bounds.min + bounds.max) * .5f, 1.f}};
+            spheres.centerX[i] = center.x;
+            spheres.centerY[i] = center.y;
+            spheres.centerZ[i] = center.z;
+            spheres.radius[i] = glm::length(bounds.max - bounds.min) * .5f * maxScales[i];
+        }
+
+        // Objects entirely off screen don't get a draw at all. The gpu cull pass does the same test later, so there
+        // is no point in doing it twice.
+        uint64_t *visibility = nullptr;
+        if (!isGpuCulling())
+        {
+            visibility = arena.allocate<uint64_t>((spheres.count + 63) / 64);
+            cullSpheres(frustumPlanes, spheres, visibility);
+        }
+
+        draws = arena.allocate<DrawItem>(spheres.count);
+        const glm::mat4 &view = camera.getView();
+        uint32_t maxCommands = 0; // for indirect drawing
+        for (uint32_t i = 0; i < spheres.count; i++)
+        {
+            if (visibility != nullptr && !isVisible(visibility, i))
+                continue;
+
+            HuhuGameObject &obj = *objects[i];
+            uint32_t lod = 0;
+            if (obj.model->getLodCount() > 1)
+            {
+                lod = obj.model->selectLod(
+                    projectedUnitsToScreen(camera, instances[i].modelMatrix, obj.model->getBounds(), maxScales[i]),
+                    LOD_SCREEN_ERROR);
+            }
+
+            InstanceData &instance = instances[i];
+            if (obj.model->getVertexFormat() == VertexFormat::Packed)
+                instance.modelMatrix = instance.modelMatrix * obj.model->getPositionDecodeMatrix();
+            instance.normalMatrix = obj.transform.normalMatrix(); // normals aren't quantized against the bounds
+
+            const glm::vec3 center{spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]};
+            const float viewDepth = (view * glm::vec4{center, 1.f}).z;
+            draws[drawCount] = {obj.model.get(), &obj, lod, i, maxScales[i], makeSortKey(*obj.model, lod, viewDepth)};
+            drawCount++;
+
+            if (indirectDrawing && obj.model->isIndexed())
+            {
+                const uint32_t meshletCount = lod == 0 ? static_cast<uint32_t>(obj.model->getMeshlets().size()) : 0;
+                maxCommands += std::max(obj.model->getDrawCommandCount(lod), meshletCount);
+            }
+        }
+        if (drawCount == 0)
+            return;
+
+        // unordered map order is as good as random, sorting by key groups the state changes and instanced runs
+        DrawItem *sortScratch = arena.allocate<DrawItem>(drawCount);
+        draws = radixSort64(draws, sortScratch, drawCount, [](const DrawItem &draw) { return draw.sortKey; });
+
+        // Instance i of the sorted list sits at index i, so a run's firstInstance is where it starts in the list. The
+        // shaders go through the visible list, which is the identity unless the cull pass compacts it.
+        reserveFrameResources(frameInfo.frameIndex, drawCount, maxCommands);
+        FrameResources &frame = frames[frameInfo.frameIndex];
+        auto *mappedInstances = static_cast<InstanceData *>(frame.instances->getMappedMemory());
+        auto *visibleInstances = static_cast<uint32_t *>(frame.visibleInstances->getMappedMemory());
+        for (uint32_t i = 0; i < drawCount; i++)
+        {
+            mappedInstances[i] = instances[draws[i].instance];
+            visibleInstances[i] = i;
+        }
+        frame.instances->markDirty(sizeof(InstanceData) * drawCount, 0);
+        frame.visibleInstances->markDirty(sizeof(uint32_t) * drawCount, 0);
+
+        if (!indirectDrawing)
+            return;
+
+        writeIndirectDraws(frameInfo);
+        if (isGpuCulling())
+            recordCulling(frameInfo);
+    }
+
+    void SimpleRenderSystem::writeIndirectDraws(FrameInfo &frameInfo)
+    {
+        FrameResources &frame = frames[frameInfo.frameIndex];
+        auto *commands = static_cast<VkDrawIndexedIndirectCommand *>(frame.drawCommands->getMappedMemory());
+        auto *cullObjects = static_cast<CullObject *>(frame.cullObjects->getMappedMemory());
+        const bool culling = isGpuCulling();
+        batches = frameInfo.frameArena.allocate<DrawBatch>(drawCount);
+
+        uint32_t first = 0;
+        while (first < drawCount)
+        {
+            const DrawItem &draw = draws[first];
+            const uint32_t instanceCount = runLength(draws, first, drawCount);
+            HuhuModel &model = *draw.model;
+
+            // a new batch whenever the pipeline or buffers change, and for every model without indices
+            DrawBatch *batch = batchCount > 0 ? &batches[batchCount - 1] : nullptr;
+            if (batch == nullptr || !model.isIndexed() || !batch->model->isIndexed() ||
+                model.getVertexFormat() != batch->model->getVertexFormat() ||
+                model.getVertexBuffer() != batch->model->getVertexBuffer() ||
+                model.getIndexBuffer() != batch->model->getIndexBuffer())
+            {
+                batch = &batches[batchCount++];
+                *batch = {&model, commandCount, 0, draw.lod, instanceCount, first};
+            }
+
+            const uint32_t firstCommand = commandCount;
+            if (model.isIndexed() && drawsMeshlets(draw, instanceCount))
+            {
+                // scratch from the frame arena, it's dropped wholesale with the rest of the frame
+                uint32_t *visibleMeshlets = frameInfo.frameArena.allocate<uint32_t>(model.getMeshlets().size());
+                const uint32_t visibleCount = cullMeshlets(frameInfo.camera, draw, visibleMeshlets);
+                commandCount += model.writeMeshletCommands(commands + commandCount, visibleMeshlets, visibleCount, first);
+            }
+            else if (model.isIndexed())
+            {
+                commandCount += model.writeDrawCommands(commands + commandCount, draw.lod, instanceCount, first);
+            }
+
+            if (culling)
+            {
+                // the cull pass counts the survivors back in, packed models are unit cubes before their matrix
+                for (uint32_t i = firstCommand; i < commandCount; i++)
+                {
+                    commands[i].instanceCount = 0;
+                }
+                const HuhuModel::BoundingBox &bounds = model.getBounds();
+                const glm::vec3 center = model.getVertexFormat() == VertexFormat::Packed ? glm::vec3{.5f} : (bounds.min + bounds.max) * .5f;
+                const float radius = glm::length(bounds.max - bounds.min) * .5f;
+                for (uint32_t i = first; i < first + instanceCount; i++)
+                {
+                    cullObjects[i] = {glm::vec4{center, radius * draws[i].maxScale}, firstCommand, commandCount - firstCommand, first, 0};
+                }
+            }
+            first += instanceCount;
+        }
+
+        for (uint32_t i = 0; i < batchCount; i++)
+        {
+            DrawBatch &batch = batches[i];
+            batch.commandCount = (i + 1 < batchCount ? batches[i + 1].firstCommand : commandCount) - batch.firstCommand;
+        }
+
+        frame.drawCommands->markDirty(sizeof(VkDrawIndexedIndirectCommand) * commandCount, 0);
+        if (culling)
+            frame.cullObjects->markDirty(sizeof(CullObject) * drawCount, 0);
+    }
+
+    void SimpleRenderSystem::recordCulling(FrameInfo &frameInfo)
+    {
+        FrameResources &frame = frames[frameInfo.frameIndex];
+        cullPipeline->bind(frameInfo.commandBuffer);
+        vkCmdBindDescriptorSets(
+            frameInfo.commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            cullPipelineLayout,
+            0,
+            1,
+            &frame.cullSet,
+            0,
+            nullptr);
+
+        CullPushConstants push{};
+        std::copy(frustumPlanes.begin(), frustumPlanes.end(), push.frustumPlanes);
+        push.objectCount = drawCount;
+        vkCmdPushConstants(frameInfo.commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push);
+        vkCmdDispatch(frameInfo.commandBuffer, (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        // the draws read the compacted instance counts and the visible list the shader just wrote
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            frameInfo.commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            0,
+            1,
+            &barrier,
+            0,
+            nullptr,
+            0,
+            nullptr);
+    }
+
+    uint32_t SimpleRenderSystem::cullMeshlets(const HuhuCamera &camera, const DrawItem &draw, uint32_t *visibleMeshlets) const
+    {
+        // the cone test is done in model space, back facing survives any affine transform so scale doesn't matter
+        const glm::mat4 modelMatrix = draw.object->transform.mat4();
+        const glm::vec3 modelEye{glm::inverse(modelMatrix) * glm::vec4{camera.getPosition(), 1.f}};
+        const bool coneCulling = backfaceCulling && camera.getProjection()[2][3] != 0.f;
+
+        const auto &meshlets = draw.model->getMeshlets();
+        uint32_t visibleCount = 0;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(meshlets.size()); i++)
+        {
+            const auto &meshlet = meshlets[i];
+            if (coneCulling)
+            {
+                const glm::vec3 toCenter = meshlet.center - modelEye;
+                if (glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius)
+                    continue;
+            }
+
+            const glm::vec3 worldCenter{modelMatrix * glm::vec4{meshlet.center, 1.f}};
+            if (!sphereInFrustum(frustumPlanes, worldCenter, meshlet.radius * draw.maxScale))
+                continue;
+
+            visibleMeshlets[visibleCount++] = i;
+        }
+        return visibleCount;
     }
 
     void SimpleRenderSystem::renderGameObjects(FrameInfo &frameInfo)
     {
-        huhuPipeline->bind(frameInfo.commandBuffer);
+        assert(prepared && "prepare() has to be called before the render pass");
+        prepared = false;
+        if (drawCount == 0)
+            return;
 
+        // the list starts with the first pipeline it needs, both share the layout so the sets stay bound across switches
+        (draws[0].model->getVertexFormat() == VertexFormat::Packed ? packedPipeline : huhuPipeline)->bind(frameInfo.commandBuffer);
+        const std::array<VkDescriptorSet, 2> descriptorSets{frameInfo.globalDescriptorSet, frames[frameInfo.frameIndex].instanceSet};
         vkCmdBindDescriptorSets(
             frameInfo.commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             pipelineLayout,
             0, // first set
-            1, // set count
-            &frameInfo.globalDescriptorSet,
-            0,      // dynamic offset count
-            nullptr // dynamic offsets data
+            static_cast<uint32_t>(descriptorSets.size()),
+            descriptorSets.data(),
+            1,                         // dynamic offset count, only the global set has one
+            &frameInfo.globalUboOffset // dynamic offsets data
         );
 
-        for (auto &kv : frameInfo.gameObjects)
+        if (batches != nullptr)
+            recordIndirectDraws(frameInfo);
+        else
+            recordDirectDraws(frameInfo);
+    }
+
+    void SimpleRenderSystem::recordDirectDraws(FrameInfo &frameInfo)
+    {
+        VertexFormat boundFormat = draws[0].model->getVertexFormat();
+        VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+        VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+        uint32_t first = 0;
+        while (first < drawCount)
         {
-            auto &obj = kv.second;
-            if (obj.model == nullptr)
-                continue; // we dont need to do model stuff with obj without models; iterating like this is still inefficient 
-            
-            SimplePushConstantData push{};
-            push.modelMatrix = obj.transform.mat4();
-            push.normalMatrix = obj.transform.normalMatrix();
+            const DrawItem &draw = draws[first];
+            const uint32_t instanceCount = runLength(draws, first, drawCount);
+            HuhuModel &model = *draw.model;
+
+            // both pipelines share the layout, so the descriptor sets stay bound across switches
+            if (model.getVertexFormat() != boundFormat)
+            {
+                boundFormat = model.getVertexFormat();
+                (boundFormat == VertexFormat::Packed ? packedPipeline : huhuPipeline)->bind(frameInfo.commandBuffer);
+            }
+
+            // models sharing a geometry arena pool share buffers, only rebind when they actually change
+            if (model.getVertexBuffer() != boundVertexBuffer || model.getIndexBuffer() != boundIndexBuffer)
+            {
+                model.bind(frameInfo.commandBuffer);
+                boundVertexBuffer = model.getVertexBuffer();
+                boundIndexBuffer = model.getIndexBuffer();
+            }
+
+            if (drawsMeshlets(draw, instanceCount))
+            {
+                uint32_t *visibleMeshlets = frameInfo.frameArena.allocate<uint32_t>(model.getMeshlets().size());
+                const uint32_t visibleCount = cullMeshlets(frameInfo.camera, draw, visibleMeshlets);
+                model.drawMeshlets(frameInfo.commandBuffer, visibleMeshlets, visibleCount, first);
+            }
+            else
+            {
+                model.draw(frameInfo.commandBuffer, draw.lod, instanceCount, first);
+            }
+            first += instanceCount;
+        }
+    }
+
+    void SimpleRenderSystem::recordIndirectDraws(FrameInfo &frameInfo)
+    {
+        VertexFormat boundFormat = draws[0].model->getVertexFormat();
+        VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+        VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+        const uint32_t maxDrawIndirectCount = huhuDevice.properties.limits.maxDrawIndirectCount;
+        HuhuBuffer &drawCommandBuffer = *frames[frameInfo.frameIndex].drawCommands;
+
+        for (uint32_t i = 0; i < batchCount; i++)
+        {
+            const DrawBatch &batch = batches[i];
+            if (batch.model->getVertexFormat() != boundFormat)
+            {
+                boundFormat = batch.model->getVertexFormat();
+                (boundFormat == VertexFormat::Packed ? packedPipeline : huhuPipeline)->bind(frameInfo.commandBuffer);
+            }
+            if (batch.model->getVertexBuffer() != boundVertexBuffer || batch.model->getIndexBuffer() != boundIndexBuffer)
+            {
+                batch.model->bind(frameInfo.commandBuffer);
+                boundVertexBuffer = batch.model->getVertexBuffer();
+                boundIndexBuffer = batch.model->getIndexBuffer();
+            }
 
-            vkCmdPushConstants(
-                frameInfo.commandBuffer,
-                pipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                0,
-                sizeof(SimplePushConstantData),
-                &push);
+            if (!batch.model->isIndexed())
+            {
+                batch.model->draw(frameInfo.commandBuffer, batch.lod, batch.instanceCount, batch.firstInstance);
+                continue;
+            }
+            if (batch.commandCount == 0)
+                continue; // every meshlet culled
 
-            obj.model->bind(frameInfo.commandBuffer);
-            obj.model->draw(frameInfo.commandBuffer);
+            // maxDrawIndirectCount is at least 65535 with multiDrawIndirect, big batches may still need splitting
+            for (uint32_t done = 0; done < batch.commandCount; done += maxDrawIndirectCount)
+            {
+                vkCmdDrawIndexedIndirect(
+                    frameInfo.commandBuffer,
+                    drawCommandBuffer.getBuffer(),
+                    sizeof(VkDrawIndexedIndirectCommand) * (batch.firstCommand + done),
+                    std::min(batch.commandCount - done, maxDrawIndirectCount),
+                    sizeof(VkDrawIndexedIndirectCommand));
+            }
         }
     }
-}
\ No newline at end of file
+}
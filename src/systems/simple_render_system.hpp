@@ -4,33 +4,105 @@
 #include "huhu_camera.hpp"
 #include "huhu_pipeline.hpp"
 #include "huhu_device.hpp"
+#include "huhu_buffer.hpp"
+#include "huhu_descriptors.hpp"
 #include "huhu_game_object.hpp"
 #include "huhu_frame_info.hpp"
 
 // std
+#include <array>
 #include <memory>
 #include <vector>
 
 namespace huhu
 {
+    struct DrawItem;
+    struct DrawBatch;
+
+    // Draws every game object with a model, objects entirely off screen are frustum culled on the cpu first. Objects
+    // sharing a model and detail level are drawn with one instanced draw, their matrices go into a per frame storage
+    // buffer the vertex shader indexes with gl_InstanceIndex. With indirect drawing the draws are written into a per
+    // frame VkDrawIndexedIndirectCommand buffer instead, and every run of models sharing a pipeline and buffers (e.g. a
+    // geometry arena pool) is a single vkCmdDrawIndexedIndirect. On top of that the frustum culling can move to a
+    // compute pass, survivors are compacted per draw with an atomic instance counter and the vertex shader finds them
+    // through a visible instance list.
     class SimpleRenderSystem
     {
     public:
+        static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;    // per frame, grows as needed
+        static constexpr uint32_t INITIAL_DRAW_COMMAND_CAPACITY = 1024; // same
+        static constexpr uint32_t CULL_GROUP_SIZE = 64;                // local_size_x of cull.comp
+
         SimpleRenderSystem(HuhuDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
         ~SimpleRenderSystem();
 
         SimpleRenderSystem(const SimpleRenderSystem &) = delete;
         SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
+        // Builds this frame's draw list and records the culling pass, so it has to come before the render pass.
+        void prepare(FrameInfo &frameInfo);
         void renderGameObjects(FrameInfo &frameInfo);
 
+        // on by default where the device has multiDrawIndirect and drawIndirectFirstInstance, can't be turned on
+        // elsewhere. Takes effect with the next prepare().
+        void setIndirectDrawing(bool enabled) { indirectDrawing = enabled && indirectDrawingSupported; }
+        bool isIndirectDrawing() const { return indirectDrawing; }
+        // only does something with indirect drawing, on by default
+        void setGpuCulling(bool enabled) { gpuCulling = enabled; }
+        bool isGpuCulling() const { return gpuCulling && indirectDrawing; }
+
     private:
+        // everything a frame in flight reads, replaced buffers go through the deletion queue
+        struct FrameResources
+        {
+            std::unique_ptr<HuhuBuffer> instances;
+            std::unique_ptr<HuhuBuffer> visibleInstances; // instance index for every gl_InstanceIndex
+            std::unique_ptr<HuhuBuffer> cullObjects;
+            std::unique_ptr<HuhuBuffer> drawCommands;
+            VkDescriptorSet instanceSet = VK_NULL_HANDLE; // set 1 of the render pipelines
+            VkDescriptorSet cullSet = VK_NULL_HANDLE;
+        };
+
+        void createFrameResources();
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
         void createPipeline(VkRenderPass renderPass);
+        void createCullPipeline();
+        // makes room for this frame's lists, repoints the frame's descriptor sets if a buffer had to grow
+        void reserveFrameResources(int frameIndex, uint32_t instanceCount, uint32_t commandCount);
+        void writeDescriptorSets(FrameResources &frame, bool overwrite);
+
+        void writeIndirectDraws(FrameInfo &frameInfo);
+        void recordCulling(FrameInfo &frameInfo);
+        void recordDirectDraws(FrameInfo &frameInfo);
+        void recordIndirectDraws(FrameInfo &frameInfo);
+        // cpu meshlet culling for an object drawn on its own, returns how many ended up in visibleMeshlets
+        uint32_t cullMeshlets(const HuhuCamera &camera, const DrawItem &draw, uint32_t *visibleMeshlets) const;
 
         HuhuDevice &huhuDevice;
 
         std::unique_ptr<HuhuPipeline> huhuPipeline;
+        std::unique_ptr<HuhuPipeline> packedPipeline; // for models using VertexFormat::Packed
         VkPipelineLayout pipelineLayout;
+        std::unique_ptr<HuhuPipeline> cullPipeline;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+
+        std::unique_ptr<HuhuDescriptorSetLayout> instanceSetLayout;
+        std::unique_ptr<HuhuDescriptorSetLayout> cullSetLayout;
+        std::unique_ptr<HuhuDescriptorPool> descriptorPool;
+        std::vector<FrameResources> frames{}; // one per frame in flight
+
+        // this frame's draw list from prepare(), lives in the frame arena
+        DrawItem *draws = nullptr;
+        uint32_t drawCount = 0;
+        DrawBatch *batches = nullptr;
+        uint32_t batchCount = 0;
+        uint32_t commandCount = 0;
+        std::array<glm::vec4, 6> frustumPlanes{};
+        bool prepared = false;
+
+        bool backfaceCulling = false; // meshlet cone culling is only valid if the pipeline drops back faces anyway
+        bool indirectDrawingSupported = false;
+        bool indirectDrawing = false;
+        bool gpuCulling = true;
     };
-}
\ No newline at end of file
+}